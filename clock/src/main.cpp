@@ -1,18 +1,223 @@
 #include <Arduino.h>
+#include <Wire.h>
+#include <ClockSync.h>
+#include <util/atomic.h>
 
-// put function declarations here:
-int myFunction(int, int);
+/*
+ * Bomb clock.
+ *
+ * The master streams ClockSync frames on its TX-only UART (see ClockSync.h).
+ * Between frames the remaining time is interpolated at millisecond
+ * resolution by the Timer1 ISR, which also times the piezo tick. The tone
+ * itself is generated by Timer2 in hardware, so neither the tick nor the
+ * countdown depend on how long a display update takes.
+ */
+
+/* METHOD DEFINITIONS */
+void initializeDisplay();
+void writeDisplayRegister(uint8_t value);
+void writeDigit(uint8_t position, uint8_t segments);
+void renderTime(uint32_t remainingMillis);
+void initializeTickTimer();
+void initializePiezo();
+void startBeep();
+void stopBeep();
+void readSync();
+void applySync(const ClockSync& sync);
+
+#define DISPLAY_ADDRESS 0x70
+#define DISPLAY_BRIGHTNESS 15
+#define DISPLAY_POSITIONS 5
+#define DISPLAY_COLON_POSITION 2
+#define SEGMENT_DOT 0x80
+#define SEGMENT_COLON 0x02
+#define SEGMENT_BLANK 0x00
+#define SEGMENT_DASH 0x40
+
+#define BEEP_MILLIS 30
+
+const int PIEZO_PIN = 3; // OC2B
+
+const uint8_t DIGIT_SEGMENTS[] PROGMEM = {
+  0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+};
+
+ClockSyncParser syncParser;
+
+/* INTERPOLATED TIME (owned by the Timer1 ISR) */
+volatile uint32_t remainingMillis = 0;
+volatile uint16_t millisToNextSecond = 1000;
+volatile uint8_t rate = CLOCK_SYNC_RATE_BASE;
+volatile uint8_t rateAccumulator = 0;
+volatile uint8_t beepRemaining = 0;
+volatile bool running = false;
+
+uint8_t clockFlags = 0;
+uint8_t shownSegments[DISPLAY_POSITIONS] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
 void setup() {
-  // put your setup code here, to run once:
-  int result = myFunction(2, 3);
+  Serial.begin(CLOCK_SYNC_BAUD);
+  Wire.begin();
+  initializeDisplay();
+  initializePiezo();
+  initializeTickTimer();
 }
 
 void loop() {
-  // put your main code here, to run repeatedly:
+  readSync();
+
+  uint32_t remaining;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    remaining = remainingMillis;
+  }
+  renderTime(remaining);
+}
+
+void readSync()
+{
+  while (Serial.available()) {
+    if (syncParser.feed(Serial.read())) {
+      applySync(syncParser.sync());
+    }
+  }
+}
+
+void applySync(const ClockSync& sync)
+{
+  uint16_t toNextSecond = sync.remainingMillis % 1000;
+  if (toNextSecond == 0) {
+    toNextSecond = 1000;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    remainingMillis = sync.remainingMillis;
+    millisToNextSecond = toNextSecond;
+    rate = clockSyncRate(sync.strikes);
+    rateAccumulator = 0;
+    running = (sync.flags & CLOCK_SYNC_RUNNING) && sync.remainingMillis > 0;
+  }
+  clockFlags = sync.flags;
+}
+
+/*
+ * 1 kHz tick. Time advances by rate / CLOCK_SYNC_RATE_BASE milliseconds
+ * per tick, so strikes speed up both the countdown and the beeps.
+ */
+ISR(TIMER1_COMPA_vect)
+{
+  if (beepRemaining > 0 && --beepRemaining == 0) {
+    stopBeep();
+  }
+
+  if (!running) {
+    return;
+  }
+
+  rateAccumulator += rate;
+  while (rateAccumulator >= CLOCK_SYNC_RATE_BASE) {
+    rateAccumulator -= CLOCK_SYNC_RATE_BASE;
+    if (remainingMillis == 0) {
+      running = false;
+      return;
+    }
+    remainingMillis--;
+    if (--millisToNextSecond == 0) {
+      millisToNextSecond = 1000;
+      beepRemaining = BEEP_MILLIS;
+      startBeep();
+    }
+  }
 }
 
-// put function definitions here:
-int myFunction(int x, int y) {
-  return x + y;
-}
\ No newline at end of file
+void initializeTickTimer()
+{
+  // CTC, prescaler 64, 16 MHz / 64 / 250 = 1 kHz
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+  OCR1A = 249;
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+void initializePiezo()
+{
+  // CTC with OCR2A as top, prescaler 32, 16 MHz / 32 / 125 / 2 = 2 kHz
+  pinMode(PIEZO_PIN, OUTPUT);
+  digitalWrite(PIEZO_PIN, LOW);
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS21) | _BV(CS20);
+  OCR2A = 124;
+  OCR2B = 0;
+}
+
+void startBeep()
+{
+  TCCR2A |= _BV(COM2B0);
+}
+
+void stopBeep()
+{
+  TCCR2A &= ~_BV(COM2B0);
+  PORTD &= ~_BV(PD3);
+}
+
+void initializeDisplay()
+{
+  writeDisplayRegister(0x21); // oscillator on
+  writeDisplayRegister(0x81); // display on, no blink
+  writeDisplayRegister(0xE0 | DISPLAY_BRIGHTNESS);
+}
+
+void writeDisplayRegister(uint8_t value)
+{
+  Wire.beginTransmission(DISPLAY_ADDRESS);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+void writeDigit(uint8_t position, uint8_t segments)
+{
+  Wire.beginTransmission(DISPLAY_ADDRESS);
+  Wire.write(position * 2);
+  Wire.write(segments);
+  Wire.endTransmission();
+}
+
+/*
+ * Renders MM:SS above one minute and SS.cc below. Only positions whose
+ * segments changed are sent, so most loop iterations cost no bus traffic.
+ */
+void renderTime(uint32_t remaining)
+{
+  uint8_t segments[DISPLAY_POSITIONS];
+
+  if (clockFlags & CLOCK_SYNC_EXPLODED) {
+    for (uint8_t i = 0; i < DISPLAY_POSITIONS; i++) {
+      segments[i] = SEGMENT_DASH;
+    }
+    segments[DISPLAY_COLON_POSITION] = SEGMENT_BLANK;
+  } else if (remaining >= 60000) {
+    uint16_t seconds = remaining / 1000;
+    uint8_t minutes = seconds / 60;
+    seconds = seconds % 60;
+    segments[0] = minutes >= 10 ? pgm_read_byte(&DIGIT_SEGMENTS[minutes / 10]) : SEGMENT_BLANK;
+    segments[1] = pgm_read_byte(&DIGIT_SEGMENTS[minutes % 10]);
+    segments[2] = SEGMENT_COLON;
+    segments[3] = pgm_read_byte(&DIGIT_SEGMENTS[seconds / 10]);
+    segments[4] = pgm_read_byte(&DIGIT_SEGMENTS[seconds % 10]);
+  } else {
+    uint8_t seconds = remaining / 1000;
+    uint8_t centis = (remaining % 1000) / 10;
+    segments[0] = pgm_read_byte(&DIGIT_SEGMENTS[seconds / 10]);
+    segments[1] = pgm_read_byte(&DIGIT_SEGMENTS[seconds % 10]) | SEGMENT_DOT;
+    segments[2] = SEGMENT_BLANK;
+    segments[3] = pgm_read_byte(&DIGIT_SEGMENTS[centis / 10]);
+    segments[4] = pgm_read_byte(&DIGIT_SEGMENTS[centis % 10]);
+  }
+
+  for (uint8_t i = 0; i < DISPLAY_POSITIONS; i++) {
+    if (segments[i] != shownSegments[i]) {
+      writeDigit(i, segments[i]);
+      shownSegments[i] = segments[i];
+    }
+  }
+}
@@ -0,0 +1,167 @@
+#include "AudioEngine.h"
+#include <TimerOne.h>
+#include <util/atomic.h>
+
+AudioEngine Audio;
+
+static void audioInterrupt()
+{
+  Audio.handleInterrupt();
+}
+
+bool AudioEngine::begin(uint8_t sdChipSelectPin)
+{
+  // ICR1 = 256 at prescaler 1, so OCR1C takes raw 8-bit samples
+  Timer1.initialize(AUDIO_CARRIER_PERIOD_US);
+  Timer1.pwm(AUDIO_PWM_PIN, 512);
+  OCR1C = AUDIO_SILENCE;
+  Timer1.attachInterrupt(audioInterrupt);
+  // Idle until there is something to play
+  TIMSK1 &= ~_BV(TOIE1);
+
+  return SD.begin(sdChipSelectPin);
+}
+
+bool AudioEngine::preload(AudioClip clip, const char* fileName)
+{
+  File file = SD.open(fileName, FILE_READ);
+  if (!file) {
+    return false;
+  }
+
+  uint16_t available = AUDIO_CACHE_SIZE - cacheUsed;
+  uint16_t length = file.size() < available ? file.size() : available;
+  length = file.read(cache + cacheUsed, length);
+  file.close();
+
+  clipOffset[clip] = cacheUsed;
+  clipLength[clip] = length;
+  cacheUsed += length;
+
+  return length > 0;
+}
+
+void AudioEngine::play(AudioClip clip)
+{
+  if (clipLength[clip] == 0) {
+    return;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    cachePointer = cache + clipOffset[clip];
+    cacheRemaining = clipLength[clip];
+    TIMSK1 |= _BV(TOIE1);
+  }
+}
+
+bool AudioEngine::playFile(const char* fileName)
+{
+  stopFile();
+
+  stream = SD.open(fileName, FILE_READ);
+  if (!stream) {
+    return false;
+  }
+  streamOpen = true;
+  streamEnded = false;
+  fillBuffer = 0;
+
+  // Prime the first buffer before the ISR starts draining
+  service();
+  TIMSK1 |= _BV(TOIE1);
+  return true;
+}
+
+void AudioEngine::stopFile()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    bufferReady[0] = false;
+    bufferReady[1] = false;
+    playBuffer = 0;
+    playPosition = 0;
+  }
+  if (streamOpen) {
+    stream.close();
+    streamOpen = false;
+  }
+  streamEnded = true;
+}
+
+bool AudioEngine::isStreaming() const
+{
+  return streamOpen || bufferReady[0] || bufferReady[1];
+}
+
+/*
+ * Refills at most one sector. Call once per loop() iteration; with a
+ * 512 byte sector at 7.8 kHz each buffer lasts ~65 ms, so the loop may
+ * stall for that long before the ISR underruns into silence.
+ */
+void AudioEngine::service()
+{
+  if (!streamOpen || bufferReady[fillBuffer]) {
+    return;
+  }
+
+  int length = stream.read(buffers[fillBuffer], AUDIO_SECTOR_SIZE);
+  if (length <= 0) {
+    stream.close();
+    streamOpen = false;
+    streamEnded = true;
+    return;
+  }
+
+  bufferLength[fillBuffer] = length;
+  bufferReady[fillBuffer] = true;
+  fillBuffer ^= 1;
+}
+
+uint16_t AudioEngine::underruns() const
+{
+  uint16_t count;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    count = underrunCount;
+  }
+  return count;
+}
+
+void AudioEngine::handleInterrupt()
+{
+  if (++decimation < AUDIO_DECIMATION) {
+    return;
+  }
+  decimation = 0;
+
+  int16_t sample = AUDIO_SILENCE;
+
+  uint8_t current = playBuffer;
+  if (!bufferReady[current] && streamEnded && cacheRemaining == 0) {
+    // Drained: hold the carrier at silence and stop interrupting
+    OCR1C = AUDIO_SILENCE;
+    TIMSK1 &= ~_BV(TOIE1);
+    return;
+  }
+
+  if (bufferReady[current]) {
+    sample = buffers[current][playPosition];
+    if (++playPosition >= bufferLength[current]) {
+      playPosition = 0;
+      bufferReady[current] = false;
+      playBuffer = current ^ 1;
+    }
+  } else if (!streamEnded) {
+    underrunCount++;
+  }
+
+  if (cacheRemaining > 0) {
+    sample += *cachePointer - AUDIO_SILENCE;
+    cachePointer++;
+    cacheRemaining--;
+    if (sample < 0) {
+      sample = 0;
+    } else if (sample > 255) {
+      sample = 255;
+    }
+  }
+
+  OCR1C = sample;
+}
@@ -0,0 +1,85 @@
+#ifndef AUDIO_ENGINE_H
+#define AUDIO_ENGINE_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+/*
+ * 8-bit unsigned mono PCM playback.
+ *
+ * Timer1 runs 8-bit phase correct PWM on OC1C (pin 13) with a 31.25 kHz
+ * carrier. Every fourth overflow the ISR loads the next sample, which gives
+ * a sample rate of 7812 Hz. The overflow interrupt is only enabled while
+ * something plays; play() and playFile() turn it on and the ISR turns it
+ * off once both buffers and the cached clip have drained. Convert clips
+ * with e.g.
+ *   sox in.wav -r 7812 -c 1 -b 8 -e unsigned OUT.RAW
+ *
+ * Long clips are streamed from SD through two sector sized buffers. The ISR
+ * only ever reads RAM; the SD card is touched exclusively from service(),
+ * which refills at most one sector per call so a single loop() iteration
+ * never pays for more than one SD read.
+ *
+ * Short clips (tick, strike) are preloaded into a RAM cache at boot and can
+ * be triggered without any SD access. Cached clips are mixed on top of the
+ * stream.
+ */
+
+#define AUDIO_PWM_PIN 13
+#define AUDIO_CARRIER_PERIOD_US 32
+#define AUDIO_DECIMATION 4
+#define AUDIO_SAMPLE_RATE (1000000UL / AUDIO_CARRIER_PERIOD_US / AUDIO_DECIMATION)
+#define AUDIO_SILENCE 128
+
+#define AUDIO_SECTOR_SIZE 512
+#ifndef AUDIO_CACHE_SIZE
+#define AUDIO_CACHE_SIZE 1024
+#endif
+
+enum AudioClip : uint8_t {
+  AUDIO_CLIP_TICK,
+  AUDIO_CLIP_STRIKE,
+  AUDIO_CLIP_COUNT
+};
+
+class AudioEngine {
+public:
+  bool begin(uint8_t sdChipSelectPin);
+  bool preload(AudioClip clip, const char* fileName);
+
+  void play(AudioClip clip);
+  bool playFile(const char* fileName);
+  void stopFile();
+  bool isStreaming() const;
+
+  void service();
+
+  uint16_t underruns() const;
+  void handleInterrupt();
+
+private:
+  File stream;
+  bool streamOpen = false;
+  volatile bool streamEnded = true;
+
+  uint8_t buffers[2][AUDIO_SECTOR_SIZE];
+  volatile uint16_t bufferLength[2] = { 0, 0 };
+  volatile bool bufferReady[2] = { false, false };
+  volatile uint8_t playBuffer = 0;
+  volatile uint16_t playPosition = 0;
+  uint8_t fillBuffer = 0;
+
+  uint8_t cache[AUDIO_CACHE_SIZE];
+  uint16_t cacheUsed = 0;
+  uint16_t clipOffset[AUDIO_CLIP_COUNT] = {};
+  uint16_t clipLength[AUDIO_CLIP_COUNT] = {};
+  const uint8_t* volatile cachePointer = nullptr;
+  volatile uint16_t cacheRemaining = 0;
+
+  volatile uint8_t decimation = 0;
+  volatile uint16_t underrunCount = 0;
+};
+
+extern AudioEngine Audio;
+
+#endif
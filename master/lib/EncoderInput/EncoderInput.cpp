@@ -0,0 +1,106 @@
+#include "EncoderInput.h"
+#include <util/atomic.h>
+
+EncoderInput Input;
+
+// Direction per (previous << 2 | current) A/B state, as in RotaryEncoder
+static const int8_t QUADRATURE_DIRECTION[16] PROGMEM = {
+  0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0
+};
+
+// Both signals high at rest (RotaryEncoder::LatchMode::FOUR3)
+static const uint8_t DETENT_STATE = 3;
+
+ISR(TIMER2_COMPA_vect)
+{
+  Input.handleInterrupt();
+}
+
+void EncoderInput::begin(uint8_t pinA, uint8_t pinB, uint8_t buttonPin)
+{
+  this->pinA = pinA;
+  this->pinB = pinB;
+  this->buttonPin = buttonPin;
+
+  pinMode(pinA, INPUT_PULLUP);
+  pinMode(pinB, INPUT_PULLUP);
+  pinMode(buttonPin, INPUT);
+  encoderState = readState();
+  buttonState = digitalRead(buttonPin);
+
+  // CTC, prescaler 64, 16 MHz / 64 / 250 = 1 kHz
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22);
+  OCR2A = F_CPU / 64 / ENCODER_SAMPLE_HZ - 1;
+  TIMSK2 |= _BV(OCIE2A);
+}
+
+/*
+ * Return what was counted since the previous call and clear it.
+ */
+EncoderDelta EncoderInput::takeSteps()
+{
+  EncoderDelta delta;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    delta.steps = steps;
+    delta.acceleratedSteps = acceleratedSteps;
+    steps = 0;
+    acceleratedSteps = 0;
+  }
+  return delta;
+}
+
+uint8_t EncoderInput::takePresses()
+{
+  uint8_t count;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    count = presses;
+    presses = 0;
+  }
+  return count;
+}
+
+uint8_t EncoderInput::readState() const
+{
+  return digitalRead(pinA) | (digitalRead(pinB) << 1);
+}
+
+void EncoderInput::handleInterrupt()
+{
+  ticks++;
+
+  uint8_t state = readState();
+  if (state != encoderState) {
+    quarterSteps += (int8_t) pgm_read_byte(&QUADRATURE_DIRECTION[encoderState << 2 | state]);
+    encoderState = state;
+
+    if (state == DETENT_STATE) {
+      int8_t direction = quarterSteps >= 2 ? 1 : (quarterSteps <= -2 ? -1 : 0);
+      quarterSteps = 0;
+
+      if (direction != 0) {
+        uint16_t interval = ticks - lastDetentTick;
+        lastDetentTick = ticks;
+        uint8_t factor = 1;
+        if (interval < ENCODER_FAST_MILLIS) {
+          factor = ENCODER_FAST_FACTOR;
+        } else if (interval < ENCODER_MEDIUM_MILLIS) {
+          factor = ENCODER_MEDIUM_FACTOR;
+        }
+        steps += direction;
+        acceleratedSteps += direction * factor;
+      }
+    }
+  }
+
+  uint8_t reading = digitalRead(buttonPin);
+  if (reading == buttonState) {
+    buttonCounter = 0;
+  } else if (++buttonCounter >= ENCODER_DEBOUNCE_MILLIS) {
+    buttonCounter = 0;
+    buttonState = reading;
+    if (buttonState == LOW && presses < 0xFF) {
+      presses++;
+    }
+  }
+}
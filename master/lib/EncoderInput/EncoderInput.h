@@ -0,0 +1,66 @@
+#ifndef ENCODER_INPUT_H
+#define ENCODER_INPUT_H
+
+#include <Arduino.h>
+
+/*
+ * Rotary encoder and push button sampled from a 1 kHz Timer2 interrupt.
+ *
+ * The encoder sits on pins 22/23, which have no pin change interrupt on the
+ * Mega, so A/B are polled at 1 kHz instead. That is well above the
+ * transition rate of a hand turned detent encoder, and the ISR keeps
+ * decoding while loop() is busy redrawing, so no detents are lost.
+ *
+ * Each detent is counted once as a plain step and once scaled by the turn
+ * speed: detents closer together than ENCODER_FAST_MILLIS count
+ * ENCODER_FAST_FACTOR, closer than ENCODER_MEDIUM_MILLIS count
+ * ENCODER_MEDIUM_FACTOR. loop() collects both with takeSteps().
+ *
+ * The button must read the same for ENCODER_DEBOUNCE_MILLIS consecutive
+ * samples before its state changes; every debounced press is counted
+ * until takePresses().
+ */
+
+#define ENCODER_SAMPLE_HZ 1000
+#define ENCODER_DEBOUNCE_MILLIS 20
+#define ENCODER_MEDIUM_MILLIS 120
+#define ENCODER_MEDIUM_FACTOR 2
+#define ENCODER_FAST_MILLIS 40
+#define ENCODER_FAST_FACTOR 5
+
+struct EncoderDelta {
+  int16_t steps;
+  int16_t acceleratedSteps;
+};
+
+class EncoderInput {
+public:
+  void begin(uint8_t pinA, uint8_t pinB, uint8_t buttonPin);
+  EncoderDelta takeSteps();
+  uint8_t takePresses();
+
+  void handleInterrupt();
+
+private:
+  uint8_t readState() const;
+
+  uint8_t pinA = 0;
+  uint8_t pinB = 0;
+  uint8_t buttonPin = 0;
+
+  uint8_t encoderState = 0;
+  int8_t quarterSteps = 0;
+  uint16_t ticks = 0;
+  uint16_t lastDetentTick = 0;
+
+  uint8_t buttonState = HIGH;
+  uint8_t buttonCounter = 0;
+
+  volatile int16_t steps = 0;
+  volatile int16_t acceleratedSteps = 0;
+  volatile uint8_t presses = 0;
+};
+
+extern EncoderInput Input;
+
+#endif
@@ -0,0 +1,234 @@
+#include "GameSnapshot.h"
+#ifdef ARDUINO
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#else
+void eeprom_read_block(void* destination, const void* source, size_t length);
+uint8_t eeprom_read_byte(const uint8_t* address);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+bool eeprom_is_ready();
+
+// avr-libc's CRC-16 (polynomial 0xA001)
+static uint16_t _crc16_update(uint16_t crc, uint8_t data)
+{
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+#endif
+
+SnapshotRing Snapshots;
+
+void SnapshotRing::begin()
+{
+  found = false;
+  for (uint8_t slot = 0; slot < SNAPSHOT_SLOTS; slot++) {
+    Record record;
+    eeprom_read_block(&record, slotAddress(slot), sizeof(record));
+    if (record.version != SNAPSHOT_VERSION || record.crc != checksum(record)) {
+      continue;
+    }
+    if (!found || newer(record.sequence, recordSequence)) {
+      stored = record.data;
+      recordSequence = record.sequence;
+      newestSlot = slot;
+      found = true;
+    }
+  }
+
+  deltaStep = 0;
+  deltaSlot = 0;
+  if (found) {
+    applyJournal();
+  }
+  queued = stored;
+  dirty = false;
+  writeLength = 0;
+  writeIndex = 0;
+}
+
+/*
+ * Replays the journal steps taken on top of the newest record. Each slot is
+ * read once; the chain ends at the first step that is missing or torn.
+ */
+void SnapshotRing::applyJournal()
+{
+  uint8_t stepAt[SNAPSHOT_JOURNAL_SLOTS];
+  uint8_t delta[DELTA_SIZE];
+  for (uint8_t slot = 0; slot < SNAPSHOT_JOURNAL_SLOTS; slot++) {
+    bool current = readDelta(slot, delta) && (delta[0] | (delta[1] << 8)) == recordSequence;
+    stepAt[slot] = current ? delta[2] : 0;
+  }
+
+  for (uint8_t step = 1; step <= SNAPSHOT_JOURNAL_SLOTS; step++) {
+    uint8_t slot = 0;
+    while (slot < SNAPSHOT_JOURNAL_SLOTS && stepAt[slot] != step) {
+      slot++;
+    }
+    if (slot == SNAPSHOT_JOURNAL_SLOTS) {
+      return;
+    }
+    readDelta(slot, delta);
+    memcpy((uint8_t*) &stored + delta[3], delta + DELTA_HEADER, delta[4]);
+    deltaStep = step;
+    deltaSlot = (slot + 1) % SNAPSHOT_JOURNAL_SLOTS;
+  }
+}
+
+bool SnapshotRing::readDelta(uint8_t slot, uint8_t* delta) const
+{
+  uint8_t* address = journalAddress(slot);
+  eeprom_read_block(delta, address, DELTA_HEADER);
+  uint8_t offset = delta[3];
+  uint8_t length = delta[4];
+  if (length == 0 || length > SNAPSHOT_DELTA_BYTES || offset + length > sizeof(GameSnapshot)) {
+    return false;
+  }
+  eeprom_read_block(delta + DELTA_HEADER, address + DELTA_HEADER, length + 2);
+  uint16_t crc = delta[DELTA_HEADER + length] | (delta[DELTA_HEADER + length + 1] << 8);
+  return crc == checksum(delta, DELTA_HEADER + length);
+}
+
+bool SnapshotRing::load(GameSnapshot& snapshot) const
+{
+  if (!found) {
+    return false;
+  }
+  snapshot = stored;
+  return true;
+}
+
+void SnapshotRing::save(const GameSnapshot& snapshot)
+{
+  if (memcmp(&snapshot, &queued, sizeof(snapshot)) == 0) {
+    return;
+  }
+  queued = snapshot;
+  dirty = true;
+}
+
+void SnapshotRing::service()
+{
+  if (writeIndex >= writeLength) {
+    if (!dirty) {
+      return;
+    }
+    prepareWrite();
+  }
+
+  while (writeIndex < writeLength && eeprom_is_ready()) {
+    uint8_t index;
+    uint8_t value;
+    writeOrder(writeIndex++, index, value);
+    if (eeprom_read_byte(writeAddress + index) != value) {
+      eeprom_write_byte(writeAddress + index, value);
+      break;
+    }
+  }
+}
+
+/*
+ * A slot that is part way through a write holds new bytes next to old ones,
+ * which now and then still pass the CRC. So the byte that makes a slot count
+ * (the version of a record, the step of a journal slot) is cleared first and
+ * written last, and a slot is never valid while it is being written.
+ */
+void SnapshotRing::writeOrder(uint8_t position, uint8_t& index, uint8_t& value) const
+{
+  uint8_t last = writeLength - 1;
+  if (position == 0 || position == last) {
+    index = commitIndex;
+    value = position == 0 ? 0 : image[commitIndex];
+    return;
+  }
+  index = position - 1;
+  if (index >= commitIndex) {
+    index++;
+  }
+  value = image[index];
+}
+
+/*
+ * Turns the queued snapshot into the bytes to write: a journal step when it
+ * differs from what is stored in one narrow span, a full record otherwise.
+ */
+void SnapshotRing::prepareWrite()
+{
+  const uint8_t* from = (const uint8_t*) &stored;
+  const uint8_t* to = (const uint8_t*) &queued;
+  uint8_t first = 0;
+  uint8_t last = sizeof(GameSnapshot);
+  while (first < last && from[first] == to[first]) {
+    first++;
+  }
+  while (last > first && from[last - 1] == to[last - 1]) {
+    last--;
+  }
+  uint8_t length = last - first;
+
+  if (found && length <= SNAPSHOT_DELTA_BYTES && deltaStep < SNAPSHOT_JOURNAL_SLOTS) {
+    image[0] = recordSequence;
+    image[1] = recordSequence >> 8;
+    image[2] = ++deltaStep;
+    image[3] = first;
+    image[4] = length;
+    memcpy(image + DELTA_HEADER, to + first, length);
+    uint16_t crc = checksum(image, DELTA_HEADER + length);
+    image[DELTA_HEADER + length] = crc;
+    image[DELTA_HEADER + length + 1] = crc >> 8;
+    writeLength = DELTA_HEADER + length + 2 + 1;
+    writeAddress = journalAddress(deltaSlot);
+    commitIndex = 2;
+    deltaSlot = (deltaSlot + 1) % SNAPSHOT_JOURNAL_SLOTS;
+  } else {
+    Record record;
+    record.version = SNAPSHOT_VERSION;
+    record.sequence = ++recordSequence;
+    record.data = queued;
+    record.crc = checksum(record);
+    memcpy(image, &record, sizeof(record));
+    writeLength = sizeof(record) + 1;
+    commitIndex = offsetof(Record, version);
+    newestSlot = (newestSlot + 1) % SNAPSHOT_SLOTS;
+    writeAddress = slotAddress(newestSlot);
+    deltaStep = 0;
+    found = true;
+  }
+
+  stored = queued;
+  dirty = false;
+  writeIndex = 0;
+}
+
+uint8_t* SnapshotRing::slotAddress(uint8_t slot)
+{
+  return (uint8_t*) (SNAPSHOT_EEPROM_BASE + slot * sizeof(Record));
+}
+
+uint8_t* SnapshotRing::journalAddress(uint8_t slot)
+{
+  return slotAddress(SNAPSHOT_SLOTS) + slot * DELTA_SIZE;
+}
+
+uint16_t SnapshotRing::checksum(const Record& record)
+{
+  return checksum((const uint8_t*) &record, offsetof(Record, crc));
+}
+
+// Seeded with the version, so steps left by older firmware never match
+uint16_t SnapshotRing::checksum(const uint8_t* bytes, uint8_t length)
+{
+  uint16_t crc = _crc16_update(0xFFFF, SNAPSHOT_VERSION);
+  for (uint8_t i = 0; i < length; i++) {
+    crc = _crc16_update(crc, bytes[i]);
+  }
+  return crc;
+}
+
+// Sequence numbers wrap, the newer one is less than half the range ahead
+bool SnapshotRing::newer(uint16_t sequence, uint16_t than)
+{
+  return (int16_t) (sequence - than) > 0;
+}
@@ -0,0 +1,107 @@
+#ifndef GAME_SNAPSHOT_H
+#define GAME_SNAPSHOT_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+// Host builds, e.g. the snapshot check, which provides the eeprom_* calls
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+/*
+ * Game state kept in EEPROM so a game survives a brownout or reset.
+ *
+ * Records go round a ring of SNAPSHOT_SLOTS slots, each save to the slot
+ * after the newest one, so the writes are spread over the whole ring. Every
+ * record carries a sequence number and a CRC; begin() picks the valid
+ * record with the highest sequence, so a record torn by a power cut is
+ * simply skipped and the one before it is used.
+ *
+ * Most saves only move the game time on or mark a module solved, so a save
+ * that differs from the last one in at most SNAPSHOT_DELTA_BYTES adjacent
+ * bytes goes to a journal instead: a slot with the changed span and its
+ * offset, the sequence of the record it applies to and a step number. load()
+ * applies the steps in order on top of the newest record and stops at the
+ * first one missing or torn. A full record is written when the change is
+ * wider or the chain fills the journal.
+ *
+ * save() only queues the snapshot. service() writes it from loop(), at most
+ * one byte per call and only when the EEPROM is idle, so a save never
+ * blocks for the 3.3 ms a byte takes. A save while a write is in progress
+ * is written once it completes, only the latest one queued. A slot only
+ * counts once its write is complete, see writeOrder().
+ */
+
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_SLOTS 32
+#define SNAPSHOT_JOURNAL_SLOTS 32
+#define SNAPSHOT_DELTA_BYTES 8
+#define SNAPSHOT_EEPROM_BASE 0
+#define SNAPSHOT_MAX_MISTAKES 3
+
+struct GameSnapshot {
+  uint32_t seed;
+  uint32_t consumedQuarterMillis;
+  uint16_t baseTime;
+  uint16_t solvedMask;     // solved modules, by request line index
+  uint8_t running;
+  uint8_t baseLives;
+  uint8_t currentLives;
+  uint8_t rosterMask;      // occupied request lines, by index
+  int8_t mistakeTrace[SNAPSHOT_MAX_MISTAKES]; // request line index per strike, -1 for none
+};
+
+class SnapshotRing {
+public:
+  void begin();
+  bool load(GameSnapshot& snapshot) const;
+  void save(const GameSnapshot& snapshot);
+  void service();
+
+  bool writing() const { return dirty || writeIndex < writeLength; }
+  uint16_t sequence() const { return recordSequence; }
+
+private:
+  struct Record {
+    uint8_t version;
+    uint16_t sequence;
+    GameSnapshot data;
+    uint16_t crc;
+  };
+
+  // Journal slot: base sequence (2), step, offset, length, bytes, CRC (2)
+  static const uint8_t DELTA_HEADER = 5;
+  static const uint8_t DELTA_SIZE = DELTA_HEADER + SNAPSHOT_DELTA_BYTES + 2;
+
+  static uint8_t* slotAddress(uint8_t slot);
+  static uint8_t* journalAddress(uint8_t slot);
+  static uint16_t checksum(const Record& record);
+  static uint16_t checksum(const uint8_t* bytes, uint8_t length);
+  static bool newer(uint16_t sequence, uint16_t than);
+
+  bool readDelta(uint8_t slot, uint8_t* delta) const;
+  void applyJournal();
+  void prepareWrite();
+  void writeOrder(uint8_t position, uint8_t& index, uint8_t& value) const;
+
+  GameSnapshot stored = {};   // what the EEPROM holds once the current write is done
+  GameSnapshot queued = {};
+  bool dirty = false;
+  bool found = false;
+  uint16_t recordSequence = 0;
+  uint8_t newestSlot = SNAPSHOT_SLOTS - 1;
+  uint8_t deltaStep = 0;
+  uint8_t deltaSlot = 0;
+
+  uint8_t image[sizeof(Record)];
+  uint8_t* writeAddress = 0;
+  uint8_t writeLength = 0;    // bytes of the image plus the commit byte's second write
+  uint8_t writeIndex = 0;
+  uint8_t commitIndex = 0;
+};
+
+extern SnapshotRing Snapshots;
+
+#endif
@@ -0,0 +1,145 @@
+#include "NeedyScheduler.h"
+
+void NeedyScheduler::setHandlers(NeedyActivateHandler activate, NeedyExpireHandler expire)
+{
+  activateHandler = activate;
+  expireHandler = expire;
+}
+
+void NeedyScheduler::begin(uint32_t seed, unsigned long now)
+{
+  reset();
+  randomState = seed != 0 ? seed : 0x9E3779B9UL;
+  lastTick = now;
+  running = true;
+}
+
+void NeedyScheduler::reset()
+{
+  for (uint8_t i = 0; i < NEEDY_WHEEL_SLOTS; i++) {
+    slotHead[i] = EMPTY;
+  }
+  for (uint8_t i = 0; i < NEEDY_MAX_MODULES; i++) {
+    entryEvent[i] = NONE;
+  }
+  cursor = 0;
+  running = false;
+}
+
+void NeedyScheduler::add(uint8_t module)
+{
+  schedule(module, ACTIVATE, randomSeconds(NEEDY_IDLE_MIN_SECONDS, NEEDY_IDLE_MAX_SECONDS));
+}
+
+/*
+ * The player dealt with the module before its deadline.
+ */
+void NeedyScheduler::calmed(uint8_t module)
+{
+  if (entryEvent[module] != EXPIRE) {
+    return;
+  }
+  schedule(module, ACTIVATE, randomSeconds(NEEDY_IDLE_MIN_SECONDS, NEEDY_IDLE_MAX_SECONDS));
+}
+
+bool NeedyScheduler::isActive(uint8_t module) const
+{
+  return entryEvent[module] == EXPIRE;
+}
+
+/*
+ * Advances the wheel by every tick elapsed since the last call. Each tick
+ * detaches one bucket and walks only the entries in it.
+ */
+void NeedyScheduler::update(unsigned long now)
+{
+  if (!running) {
+    return;
+  }
+
+  while (now - lastTick >= NEEDY_TICK_MILLIS) {
+    lastTick += NEEDY_TICK_MILLIS;
+    cursor = (cursor + 1) % NEEDY_WHEEL_SLOTS;
+
+    uint8_t module = slotHead[cursor];
+    slotHead[cursor] = EMPTY;
+    while (module != EMPTY) {
+      uint8_t next = nextEntry[module];
+      if (entryRounds[module] > 0) {
+        entryRounds[module]--;
+        insert(module, cursor);
+      } else {
+        fire(module);
+      }
+      module = next;
+    }
+  }
+}
+
+void NeedyScheduler::fire(uint8_t module)
+{
+  Event event = entryEvent[module];
+  entryEvent[module] = NONE;
+
+  if (event == ACTIVATE) {
+    uint16_t seconds = randomSeconds(NEEDY_ACTIVE_MIN_SECONDS, NEEDY_ACTIVE_MAX_SECONDS);
+    schedule(module, EXPIRE, seconds);
+    if (activateHandler) {
+      activateHandler(module, seconds);
+    }
+  } else if (event == EXPIRE) {
+    add(module);
+    if (expireHandler) {
+      expireHandler(module);
+    }
+  }
+}
+
+void NeedyScheduler::schedule(uint8_t module, Event event, uint16_t seconds)
+{
+  cancel(module);
+
+  uint16_t ticks = (uint32_t) seconds * 1000 / NEEDY_TICK_MILLIS;
+  if (ticks == 0) {
+    ticks = 1;
+  }
+  entryEvent[module] = event;
+  entryRounds[module] = (ticks - 1) / NEEDY_WHEEL_SLOTS;
+  insert(module, (cursor + ticks) % NEEDY_WHEEL_SLOTS);
+}
+
+void NeedyScheduler::insert(uint8_t module, uint8_t slot)
+{
+  entrySlot[module] = slot;
+  prevEntry[module] = EMPTY;
+  nextEntry[module] = slotHead[slot];
+  if (slotHead[slot] != EMPTY) {
+    prevEntry[slotHead[slot]] = module;
+  }
+  slotHead[slot] = module;
+}
+
+void NeedyScheduler::cancel(uint8_t module)
+{
+  if (entryEvent[module] == NONE) {
+    return;
+  }
+  entryEvent[module] = NONE;
+
+  if (prevEntry[module] != EMPTY) {
+    nextEntry[prevEntry[module]] = nextEntry[module];
+  } else {
+    slotHead[entrySlot[module]] = nextEntry[module];
+  }
+  if (nextEntry[module] != EMPTY) {
+    prevEntry[nextEntry[module]] = prevEntry[module];
+  }
+}
+
+uint16_t NeedyScheduler::randomSeconds(uint16_t low, uint16_t high)
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return low + randomState % (high - low + 1);
+}
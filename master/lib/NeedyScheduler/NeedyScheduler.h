@@ -0,0 +1,69 @@
+#ifndef NEEDY_SCHEDULER_H
+#define NEEDY_SCHEDULER_H
+
+#include <stdint.h>
+
+/*
+ * Activates needy modules on randomized timers.
+ *
+ * Each needy module alternates between idle and active. Idle and active
+ * durations are drawn from a xorshift generator seeded with the game seed,
+ * so the same seed always produces the same schedule.
+ *
+ * Deadlines live in a hashed timer wheel: NEEDY_WHEEL_SLOTS buckets of
+ * NEEDY_TICK_MILLIS each, with a rounds counter for delays longer than one
+ * revolution. A tick only visits the entries of a single bucket.
+ */
+
+#define NEEDY_MAX_MODULES 11
+#define NEEDY_TICK_MILLIS 250
+#define NEEDY_WHEEL_SLOTS 32
+
+#define NEEDY_IDLE_MIN_SECONDS 20
+#define NEEDY_IDLE_MAX_SECONDS 50
+#define NEEDY_ACTIVE_MIN_SECONDS 30
+#define NEEDY_ACTIVE_MAX_SECONDS 45
+
+typedef void (*NeedyActivateHandler)(uint8_t module, uint16_t seconds);
+typedef void (*NeedyExpireHandler)(uint8_t module);
+
+class NeedyScheduler {
+public:
+  void setHandlers(NeedyActivateHandler activate, NeedyExpireHandler expire);
+
+  void begin(uint32_t seed, unsigned long now);
+  void add(uint8_t module);
+  void calmed(uint8_t module);
+  bool isActive(uint8_t module) const;
+  void reset();
+
+  void update(unsigned long now);
+
+private:
+  enum Event : uint8_t { NONE, ACTIVATE, EXPIRE };
+
+  static const uint8_t EMPTY = 0xFF;
+
+  void schedule(uint8_t module, Event event, uint16_t seconds);
+  void insert(uint8_t module, uint8_t slot);
+  void cancel(uint8_t module);
+  void fire(uint8_t module);
+  uint16_t randomSeconds(uint16_t low, uint16_t high);
+
+  NeedyActivateHandler activateHandler = nullptr;
+  NeedyExpireHandler expireHandler = nullptr;
+
+  uint8_t slotHead[NEEDY_WHEEL_SLOTS];
+  uint8_t nextEntry[NEEDY_MAX_MODULES];
+  uint8_t prevEntry[NEEDY_MAX_MODULES];
+  uint8_t entrySlot[NEEDY_MAX_MODULES];
+  uint8_t entryRounds[NEEDY_MAX_MODULES];
+  Event entryEvent[NEEDY_MAX_MODULES];
+
+  uint8_t cursor = 0;
+  unsigned long lastTick = 0;
+  uint32_t randomState = 1;
+  bool running = false;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "Profiler.h"
+
+Profiler profiler;
+
+Profiler::Profiler()
+{
+  reset();
+}
+
+uint32_t Profiler::bucketLimit(uint8_t bucket)
+{
+  return 16UL << (2 * bucket);
+}
+
+void Profiler::record(uint8_t section, uint32_t elapsedMicros)
+{
+  if (section >= PROFILER_MAX_SECTIONS) {
+    return;
+  }
+
+  ProfileStats& stats = sections[section];
+  stats.count++;
+  stats.total += elapsedMicros;
+  if (elapsedMicros < stats.min) {
+    stats.min = elapsedMicros;
+  }
+  if (elapsedMicros > stats.max) {
+    stats.max = elapsedMicros;
+  }
+
+  uint8_t bucket = 0;
+  while (bucket < PROFILER_BUCKETS - 1 && elapsedMicros >= bucketLimit(bucket)) {
+    bucket++;
+  }
+  if (stats.histogram[bucket] < 0xFFFF) {
+    stats.histogram[bucket]++;
+  }
+}
+
+void Profiler::beginIteration()
+{
+  iterationStart = profilerMicros();
+}
+
+/*
+ * Returns true when the iteration took longer than the loop budget.
+ */
+bool Profiler::endIteration()
+{
+  lastIterationMicros = profilerMicros() - iterationStart;
+  record(PROFILER_LOOP_SECTION, lastIterationMicros);
+  if (lastIterationMicros > budgetMicros) {
+    overrunCount++;
+    return true;
+  }
+  return false;
+}
+
+void Profiler::reset()
+{
+  for (uint8_t i = 0; i < PROFILER_MAX_SECTIONS; i++) {
+    ProfileStats& stats = sections[i];
+    stats.count = 0;
+    stats.total = 0;
+    stats.min = 0xFFFFFFFFUL;
+    stats.max = 0;
+    for (uint8_t bucket = 0; bucket < PROFILER_BUCKETS; bucket++) {
+      stats.histogram[bucket] = 0;
+    }
+  }
+  overrunCount = 0;
+}
@@ -0,0 +1,100 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+/*
+ * Section timing for loop().
+ *
+ * PROFILE_SCOPE(section) times the rest of the enclosing block with
+ * micros() and books it to the section: count, min, average, max and a
+ * histogram with power-of-four buckets (<16 us, <64 us, ... >=65 ms).
+ * beginIteration() / endIteration() bracket one loop() pass, which is
+ * booked to PROFILER_LOOP_SECTION and checked against the loop budget.
+ *
+ * The library has no Arduino dependency besides the clock, so it builds
+ * unchanged on the host where std::chrono stands in for micros().
+ * Without PROFILING defined the PROFILE_ macros compile to nothing.
+ */
+
+#ifdef ARDUINO
+#include <Arduino.h>
+inline uint32_t profilerMicros() { return micros(); }
+#else
+#include <chrono>
+inline uint32_t profilerMicros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#define PROFILER_MAX_SECTIONS 16
+#define PROFILER_BUCKETS 8
+#define PROFILER_LOOP_SECTION 0
+#define PROFILER_NO_SECTION 0xFF
+
+#ifndef PROFILER_LOOP_BUDGET_MICROS
+#define PROFILER_LOOP_BUDGET_MICROS 20000
+#endif
+
+struct ProfileStats {
+  uint32_t count;
+  uint32_t total;
+  uint32_t min;
+  uint32_t max;
+  uint16_t histogram[PROFILER_BUCKETS];
+
+  uint32_t average() const { return count > 0 ? total / count : 0; }
+};
+
+class Profiler {
+public:
+  Profiler();
+
+  void record(uint8_t section, uint32_t elapsedMicros);
+  void beginIteration();
+  bool endIteration();
+  void reset();
+
+  void setBudget(uint32_t micros) { budgetMicros = micros; }
+  uint32_t budget() const { return budgetMicros; }
+  uint32_t overruns() const { return overrunCount; }
+  uint32_t lastIteration() const { return lastIterationMicros; }
+
+  const ProfileStats& stats(uint8_t section) const { return sections[section]; }
+  static uint32_t bucketLimit(uint8_t bucket);
+
+private:
+  ProfileStats sections[PROFILER_MAX_SECTIONS];
+  uint32_t budgetMicros = PROFILER_LOOP_BUDGET_MICROS;
+  uint32_t overrunCount = 0;
+  uint32_t iterationStart = 0;
+  uint32_t lastIterationMicros = 0;
+};
+
+extern Profiler profiler;
+
+class ProfileScope {
+public:
+  explicit ProfileScope(uint8_t section) : section(section), start(profilerMicros()) {}
+  ~ProfileScope() { profiler.record(section, profilerMicros() - start); }
+
+private:
+  uint8_t section;
+  uint32_t start;
+};
+
+#ifdef PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(section) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(section)
+#define PROFILE_LOOP_BEGIN() profiler.beginIteration()
+#define PROFILE_LOOP_END() profiler.endIteration()
+#else
+#define PROFILE_SCOPE(section) do {} while (0)
+#define PROFILE_LOOP_BEGIN() do {} while (0)
+#define PROFILE_LOOP_END() false
+#endif
+
+#endif
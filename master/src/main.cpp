@@ -1,6 +1,6 @@
 #include "Arduino.h"
 #include <Wire.h>
-#include <ArduinoJson.h>
+#include <avr/wdt.h>
 #include <stdlib.h>
 #include <GxEPD2_BW.h>
 #include <Adafruit_GFX.h>    // Core graphics library
@@ -9,27 +9,27 @@
 #include <SPI.h>
 #include <Fonts/FreeMonoBold24pt7b.h>
 #include <Fonts/FreeMono9pt7b.h>
-#include <RotaryEncoder.h>
 #include <TimerOne.h>
 #include <TimerFive.h>
 #include <SD.h>
-#include <TMRpcm.h>
+#include <AudioEngine.h>
+#include <EncoderInput.h>
+#include <ClockSync.h>
+#include <NeedyScheduler.h>
+#include <TokenLog.h>
+#include <BombConstants.h>
+#include <Protocol.h>
+#include <Edgework.h>
+#include <MemDiag.h>
+#include <Profiler.h>
+#include <GameSnapshot.h>
 
 /*
  * TODOS:
- * - SD Card
- * - PCM speaker
  * - Battery Display
  * - Ports Display
- * -> external clock (with piezo)
  */
 
-struct Label {
-  String label;
-  bool lit;
-};
-
-void generateSerialNumber(int length = 8);
 void initializeSerialDisplay();
 void displaySerialNumber();
 void blankSerialNumber();
@@ -40,16 +40,31 @@ void enableMistakeLED();
 void initializeClock();
 void startClock();
 void stopClock();
+void clockTick();
+void updateGameTime();
+unsigned long getRemainingMillis();
+void sendClockSync(bool running);
+void sendTimeSync();
+
+void initializeAudio();
 
 void setupGame();
+void resetGameState();
 void provisionModules();
+bool resumeGame();
+void saveSnapshot(bool running);
+uint8_t rosterMask();
+int requestLineOf(int moduleId);
+int moduleOnRequestLine(int line);
+void fillProvision(ProvisionMessage& provision);
+void checkRematch();
 void startGame();
 
 void initializeMenuDisplay();
 void displayMenu();
 String getTimeForDisplay();
 void blankMenuDisplay();
-void displayTextOnMenuDisplay(String message);
+void displayTextOnMenuDisplay(const __FlashStringHelper* message);
 
 void initializeLabelDisplays();
 void displayLabels();
@@ -60,18 +75,36 @@ void seedRandomness();
 void doScanForRequests(bool alwaysCheck = false);
 void initializeRequestPins();
 void discoverModules();
-byte sendCommand(byte address, String command);
-void broadcastToAllModules(String command);
-String readFromModule(int address);
+void reclaimAddresses();
+bool probeAddress(byte address);
+bool isKnownAddress(byte address);
+byte nextFreeAddress();
+bool isAssignedPin(int pin);
+void selectRequestPin(int pin);
+void releaseRequestPins();
+void offerAddress(int requestPin, byte address);
+bool assignAddress(int requestPin, byte address);
+void registerModule(byte i2cAddress, int requestPin);
+void removeModule(int moduleId);
+void serviceHotPlug();
+void continueEnrollment();
+int findModule(byte address);
+void noteBusResult(byte address, bool answered);
+void selectBusSpeed(byte address);
+void slowDownModule(int moduleId);
+void superviseModules();
+void missHeartbeat(int moduleId);
+void recoverModule(int moduleId);
+void watchdogDelay(unsigned long ms);
+byte sendFrame(byte address, const uint8_t* frame, uint8_t length);
+template <typename Message> byte sendMessage(byte address, const Message& message);
+bool readFromModule(int moduleId);
+bool awaitReply(int moduleId);
 int findRequestPin();
 void enableModule(byte i2cAddress, int requestPin);
 void enableModuleInterrupt();
 void incomingRequest();
 
-void generateLabels();
-void generateBatteries();
-void generatePorts();
-bool intIssetInArray(int haystack[], int search);
 
 bool checkReady();
 void checkSolved();
@@ -79,9 +112,20 @@ void checkMistakes();
 void markModuleAsSolved(int moduleId);
 void addMistakeFromModule(int moduleId);
 
-#define MODULE_START_ADDRESS 0x00  // Starting I2C address
-#define MODULE_END_ADDRESS 0x7F    // Ending I2C address
+void startNeedyModules();
+void activateNeedyModule(uint8_t moduleId, uint16_t seconds);
+void expireNeedyModule(uint8_t moduleId);
+void deactivateNeedyModule(uint8_t moduleId);
+void calmNeedyModule(int moduleId);
+void stopNeedyModules();
+
+uint8_t profileStateSection(int state);
+void checkSerialCommands();
+void runSerialCommand();
+void dumpProfile();
+
 const int REQUEST_PINS[] = { /*23,*/ 24, 25, 26, 27, 28, 29, 30, 31/*, 32, 33*/ };
+const int REQUEST_PIN_COUNT = sizeof(REQUEST_PINS) / sizeof(REQUEST_PINS[0]);
 int LABEL_PINS[] = { 11, 12, 14, 16 };
 int LABEL_LED_PINS[] = { 36, 37, 38, 39 };
 Adafruit_ST7735* LABEL_DISPLAYS[4] = {};
@@ -94,13 +138,78 @@ int ASSIGNED_REQUEST_PINS[] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
 bool SOLVED_MODULES[] = { true, true, true, true, true, true, true, true, true, true, true };
 bool NEEDY_MODULES[] = { false, false, false, false, false, false, false, false, false, false, false };
 bool READY_MODULES[] = { true, true, true, true, true, true, true, true, true, true, true };
-String MODULE_TYPES[] = { "", "", "", "", "", "", "", "", "", "", "" };
+bool PROVISIONED_MODULES[] = { false, false, false, false, false, false, false, false, false, false, false };
+uint8_t MODULE_TYPES[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 int MISTAKE_TRACE[] = { -1, -1, -1 };
-int randomnessSeed = 0;
+uint32_t randomnessSeed = 0;
+
+NeedyScheduler needyScheduler;
 
-const bool debug = true;
 bool scanForRequest = false;
 
+/* HOT PLUG */
+const unsigned long HOTPLUG_PING_INTERVAL = 50;   // one known module is pinged per interval
+const unsigned long HOTPLUG_PROBE_INTERVAL = 250; // the default address is probed per interval
+const unsigned long HOTPLUG_BUDGET_MICROS = 1500; // bus time per loop() spent on hot plug
+const unsigned long ASSIGN_TIMEOUT = 20;          // for a module to move to its new address
+const unsigned long REPLY_TIMEOUT = 20;           // for a module to queue a reply from its loop()
+const int HOTPLUG_MAX_MISSED_PINGS = 3;
+const int ENROLL_IDLE = 0;
+const int ENROLL_ASSIGN = 1;
+const int ENROLL_CONFIRM = 2;
+const int ENROLL_READ = 3;
+int MISSED_PINGS[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+int hotPlugPingIndex = 0;
+unsigned long hotPlugLastPing = 0;
+unsigned long hotPlugLastProbe = 0;
+int enrollState = ENROLL_IDLE;
+byte enrollAddress = 0;
+int enrollPinIndex = 0;
+int enrollRequestPin = 0;
+unsigned long enrollTimer = 0;
+
+/* BUS SPEED */
+// Fast mode relies on the external pull-ups, not the AVR's internal ones
+const uint16_t BUS_MAX_KHZ = PROTOCOL_BUS_FAST_KHZ;
+uint16_t BUS_KHZ[] = { 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100 };
+uint8_t MAX_FRAMES[] = { 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32 };
+uint16_t busKHz = PROTOCOL_BUS_STANDARD_KHZ;
+
+/* SUPERVISION */
+// Wire times the whole transaction: the longest frame, Provision at 100 kHz,
+// takes about 2.7 ms, doubled for modules stretching the clock (tools/busmodel.py)
+const unsigned long BUS_TIMEOUT_MICROS = 6000;    // a stuck transaction is aborted and the bus reset
+const unsigned long HEARTBEAT_SILENCE = 100;      // a module not heard from for this long is probed
+const unsigned long SUPERVISION_INTERVAL = 10;    // at most one probe per interval
+const int HEALTH_OK = 0;
+const int HEALTH_SUSPECT = 1;
+const int HEALTH_FAILED = 2;
+int MODULE_HEALTH[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+unsigned long LAST_HEARD[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+int supervisionIndex = 0;
+unsigned long supervisionLastCheck = 0;
+volatile bool clockTicked = false;
+
+/* PROFILING */
+// Sections 0..7 are functions, 8.. are loop() states 1..8
+const uint8_t PROFILE_CHECK_ROTENC = 1;
+const uint8_t PROFILE_CHECK_ROTENC_BUTTON = 2;
+const uint8_t PROFILE_SCAN_REQUESTS = 3;
+const uint8_t PROFILE_DISPLAY_MENU = 4;
+const uint8_t PROFILE_DISPLAY_TEXT = 5;
+const uint8_t PROFILE_HOTPLUG = 6;
+const uint8_t PROFILE_AUDIO_SERVICE = 7;
+const uint8_t PROFILE_STATE_BASE = 8;
+const uint8_t PROFILE_STATE_COUNT = 8;
+const uint8_t SERIAL_COMMAND_LENGTH = 12;
+char serialCommand[SERIAL_COMMAND_LENGTH + 1] = "";
+uint8_t serialCommandLength = 0;
+const uint8_t PROFILE_DUMP_IDLE = 0xFF;
+uint8_t profileDumpSection = PROFILE_DUMP_IDLE; // next section dumpProfile() reports
+// Overruns come in runs, one warning per interval keeps them from flooding the log
+const unsigned long OVERRUN_LOG_INTERVAL = 1000;
+unsigned long lastOverrunLog = 0;
+
 /* PIN DEFINITIONS */
 const uint8_t RANDOMNESS_SOURCE = A1;
 const int REQUEST_INTERRUPT_PIN = 3;
@@ -119,39 +228,29 @@ const int ROTENC_B = 23;
 const int CLOCK_PIN = 45;
 const int MISTAKE_A_LED = 32;
 const int MISTAKE_B_LED = 33;
-
-/* GAME BOUNDARIES */
-// Ports
-const int maxPortsTotal = 5;
-const int maxPortsPerType = 2;
-const String possiblePorts[] = {"VGA", "PS2", "RJ45", "RCA"};
-
-// Labels
-const int maxLabels = 4;
-const String possibleLabels[] = {"SND", "CLR", "CAR", "IND", "FRQ", "SIG", "NSA", "MSA", "TRN", "BOB", "FRK"};
-
-// Batteries
-const int maxBatteriesTotal = 6;
-const int maxBatteriesAA = 6;
-const int maxBatteriesD = 2;
-const String possibleBatteryTypes[] = {"AA", "D"};
-
+const int SD_CS_PIN = 53;
 
 /* GAME SETTINGS */
 int baseLives = 3;
 int currentLives = -1;
 int baseTime = 480;
-int currentTime = -1;
-String gameResult = "";
-String serialNumber = "";
-Label bombLabels[maxLabels] = {};
-int generatedLabelCount = 0;
-int portCountVGA = 0;
-int portCountPS2 = 0;
-int portCountRJ45 = 0;
-int portCountRCA = 0;
-int batteryCountAA = 0;
-int batteryCountD = 0;
+unsigned long consumedQuarterMillis = 0; // game time used, scaled by clockSyncRate()
+unsigned long lastTimeUpdate = 0;
+unsigned long lastClockSync = 0;
+const unsigned long CLOCK_SYNC_INTERVAL = 1000;
+const int GAME_RUNNING = 0;
+const int GAME_DEFUSED = 1;
+const int GAME_EXPLODED = 2;
+int gameResult = GAME_RUNNING;
+Edgework edgework = {};
+// Settings the modules were last provisioned with, a rematch only sends changes
+int provisionedLives = -1;
+int provisionedTime = -1;
+
+/* SNAPSHOTS */
+const unsigned long SNAPSHOT_INTERVAL = 10000; // game time lost at most on a resume
+unsigned long lastSnapshot = 0;
+bool resuming = false;
 
 /* EINK SERIAL DISPLAY */
 const int SERIAL_DISPLAY_ROTATION = 1;
@@ -165,17 +264,6 @@ Adafruit_ST7789 menuDisplay = Adafruit_ST7789(MENU_DISPLAY_CS_PIN, MENU_DISPLAY_
 int menuCursorPosition = 1;
 int selectedMenuPosition = 0;
 
-/* ROTARY ENCODER */
-RotaryEncoder encoder(ROTENC_A, ROTENC_B, RotaryEncoder::LatchMode::FOUR3);
-int globalPos = 0;
-int rotEncButtonState = HIGH;            // the current reading from the input pin
-int rotEncLastButtonState = HIGH;  // the previous reading from the input pin
-
-// the following variables are unsigned longs because the time, measured in
-// milliseconds, will quickly become a bigger number than can be stored in an int.
-unsigned long rotEncLastDebounceTime = 0;  // the last time the output pin was toggled
-unsigned long rotEncDebounceDelay = 50;    // the debounce time; increase if the output flickers
-
 int globalState = 1;
 /*
  * 1  boot
@@ -186,172 +274,535 @@ int globalState = 1;
  * 6  enable displays
  * 7  game
  * 8  game ended
+ * 99 game over, press for a rematch or turn for the menu
  */
 
 void setup()
 {
-  if (debug) {
-    Serial.begin(9600);
-  }
+  logBegin();
+  LOG_INFO(BOOT);
+  memDiagBegin();
   seedRandomness();
   initializeMenuDisplay();
-  displayTextOnMenuDisplay("Please wait...");
+  displayTextOnMenuDisplay(F("Please wait..."));
+  initializeAudio();
   initializeRequestPins();
   //initializeSerialDisplay();
   initializeLabelLEDs();
   initializeMistakeLEDs();
+  needyScheduler.setHandlers(activateNeedyModule, expireNeedyModule);
   Wire.begin();
+  Wire.setWireTimeout(BUS_TIMEOUT_MICROS, true);
   discoverModules();
+  Snapshots.begin();
   blankMenuDisplay();
   displayMenu();
 
   checkSolved();
 
   globalState = 2;
+  // after discoverModules(), which also takes back modules the reset left on their addresses
+  if (resumeGame()) {
+    globalState = 4;
+  }
+  wdt_enable(WDTO_1S);
 }
 
 void loop()
 {
-  switch (globalState) {
-    case 1:
-      //doScanForRequests();
-      break;
-    case 2:
-      checkRotEncButton();
-      checkRotEnc();
-      break;
-    case 3:
-      displayTextOnMenuDisplay("Setting up Game");
-      setupGame();
-      displayTextOnMenuDisplay("Prov'ing Modules");
-      provisionModules();
-      initializeClock();
-      //initializeLabelDisplays();
-      globalState = 4;
-      break;
-    case 4:
-      // if all ready: globalState = 5;
-      displayTextOnMenuDisplay("Wating on Modules");
-      doScanForRequests(true);
-      if (checkReady()) {
-        globalState = 5;
+  PROFILE_LOOP_BEGIN();
+  wdt_reset();
+  logFlush();
+  memDiagSample(globalState);
+  {
+    PROFILE_SCOPE(PROFILE_AUDIO_SERVICE);
+    Audio.service();
+  }
+  Snapshots.service();
+
+  {
+    PROFILE_SCOPE(profileStateSection(globalState));
+    switch (globalState) {
+      case 1:
+        //doScanForRequests();
+        break;
+      case 2:
+        checkRotEncButton();
+        checkRotEnc();
+        if (globalState == 2) {
+          serviceHotPlug();
+        }
+        break;
+      case 3:
+        displayTextOnMenuDisplay(F("Setting up Game"));
+        setupGame();
+        displayTextOnMenuDisplay(F("Prov'ing Modules"));
+        provisionModules();
+        initializeClock();
+        //initializeLabelDisplays();
+        globalState = 4;
+        break;
+      case 4:
+        // if all ready: globalState = 5;
+        displayTextOnMenuDisplay(F("Wating on Modules"));
+        doScanForRequests(true);
+        superviseModules();
+        if (checkReady()) {
+          globalState = 5;
+        }
+        break;
+      case 5:
+        // if all ready: globalState = 5;
+        // a resumed game goes straight back to the clock
+        if (!resuming) {
+          displayTextOnMenuDisplay(F("Ready?"));
+          //displayLabels();
+          //displaySerialNumber();
+          displayTextOnMenuDisplay(F("3"));
+          watchdogDelay(1000);
+          displayTextOnMenuDisplay(F("2"));
+          watchdogDelay(1000);
+          displayTextOnMenuDisplay(F("1"));
+          watchdogDelay(1000);
+        }
+        resuming = false;
+        enableModuleInterrupt();
+        startClock();
+        startNeedyModules();
+        saveSnapshot(true);
+        globalState = 6;
+        break;
+      case 6:
+        blankMenuDisplay();
+        globalState = 7;
+        break;
+      case 7:
+        updateGameTime();
+        needyScheduler.update(millis());
+        doScanForRequests();
+        superviseModules();
+        if (millis() - lastSnapshot >= SNAPSHOT_INTERVAL) {
+          saveSnapshot(true);
+        }
+        if (clockTicked) {
+          clockTicked = false;
+          Audio.play(AUDIO_CLIP_TICK);
+        }
+        break;
+      case 8:
+        stopClock();
+        stopNeedyModules();
+        saveSnapshot(false);
+        sendClockSync(false);
+        blankSerialNumber();
+        displayTextOnMenuDisplay(gameResult == GAME_DEFUSED ? F("success") : F("failed"));
+        memDiagReport();
+        Input.takeSteps();
+        Input.takePresses();
+        globalState = 99;
+        break;
+      case 99:
+        checkRematch();
+        break;
+    }
+  }
+
+  checkSerialCommands();
+  dumpProfile();
+
+  if (PROFILE_LOOP_END() && millis() - lastOverrunLog >= OVERRUN_LOG_INTERVAL) {
+    lastOverrunLog = millis();
+    LOG_WARN(LOOP_OVERRUN, profiler.lastIteration(), globalState, profiler.overruns());
+  }
+}
+
+uint8_t profileStateSection(int state)
+{
+  if (state < 1 || state > PROFILE_STATE_COUNT) {
+    return PROFILER_NO_SECTION;
+  }
+  return PROFILE_STATE_BASE + state - 1;
+}
+
+/*
+ * Line based commands on the debug port, answered through the log:
+ * p - dump the loop profile
+ * r - reset the loop profile
+ * m - memory report
+ * b<ms> - set the loop budget
+ */
+void checkSerialCommands()
+{
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\n' || c == '\r') {
+      serialCommand[serialCommandLength] = '\0';
+      if (serialCommandLength > 0) {
+        runSerialCommand();
       }
+      serialCommandLength = 0;
+    } else if (serialCommandLength < SERIAL_COMMAND_LENGTH) {
+      serialCommand[serialCommandLength++] = c;
+    }
+  }
+}
+
+void runSerialCommand()
+{
+  switch (serialCommand[0]) {
+    case 'p':
+      profileDumpSection = 0;
       break;
-    case 5:
-      // if all ready: globalState = 5;
-      displayTextOnMenuDisplay("Ready?");
-      //displayLabels();
-      //displaySerialNumber();
-      displayTextOnMenuDisplay("3");
-      delay(1000);
-      displayTextOnMenuDisplay("2");
-      delay(1000);
-      displayTextOnMenuDisplay("1");
-      delay(1000);
-      enableModuleInterrupt();
-      startClock();
-      globalState = 6;
-      break;
-    case 6:
-      blankMenuDisplay();
-      globalState = 7;
+    case 'r':
+      profiler.reset();
       break;
-    case 7:
-      doScanForRequests();
+    case 'm':
+      memDiagReport();
       break;
-    case 8:
-      blankSerialNumber();
-      displayTextOnMenuDisplay(gameResult);
-      globalState = 99;
+    case 'b':
+      profiler.setBudget(strtoul(serialCommand + 1, NULL, 10) * 1000UL);
       break;
   }
 }
 
+/*
+ * Reports one profiled section per loop() pass, and only once the log ring
+ * has drained, so the whole report fits through the ring without drops.
+ * The last bucket holds everything at or over the one below it.
+ */
+void dumpProfile()
+{
+  if (profileDumpSection == PROFILE_DUMP_IDLE || !logIdle()) {
+    return;
+  }
+  while (profileDumpSection < PROFILER_MAX_SECTIONS && profiler.stats(profileDumpSection).count == 0) {
+    profileDumpSection++;
+  }
+  if (profileDumpSection == PROFILER_MAX_SECTIONS) {
+    LOG_INFO(PROFILE_OVERRUNS, profiler.overruns(), profiler.budget());
+    profileDumpSection = PROFILE_DUMP_IDLE;
+    return;
+  }
+
+  uint8_t section = profileDumpSection++;
+  const ProfileStats& stats = profiler.stats(section);
+  LOG_INFO(PROFILE_SECTION, section, stats.count, stats.average());
+  LOG_INFO(PROFILE_RANGE, section, stats.min, stats.max);
+  for (uint8_t bucket = 0; bucket < PROFILER_BUCKETS - 1; bucket++) {
+    if (stats.histogram[bucket] > 0) {
+      LOG_INFO(PROFILE_BUCKET, section, stats.histogram[bucket], Profiler::bucketLimit(bucket));
+    }
+  }
+  uint16_t over = stats.histogram[PROFILER_BUCKETS - 1];
+  if (over > 0) {
+    LOG_INFO(PROFILE_BUCKET_OVER, section, over, Profiler::bucketLimit(PROFILER_BUCKETS - 2));
+  }
+}
+
 void seedRandomness() {
   randomnessSeed = analogRead(RANDOMNESS_SOURCE);
   randomSeed(randomnessSeed);
 }
 
-void generateSerialNumber(int length) {
-  String letterList[] = {"A","B","C","D","E","F","G","H","J","K","L","M","N","P","Q","R","S","T","U","V","W","X","Y","Z","A","B","C","D","F","G","H","J","K","L","M","N","P","Q","R","S","T","V","W","X","Y","Z","1","2","3","4","5","6","7","8","9"};  int listLength = 56;
-  String output = "";
-  for (int i = 0; i < length; i++) {
-    output += letterList[random(0, listLength - 1)];
-  }
-  serialNumber = output;
-}
-
 void initializeRequestPins() {
-  for (int i = 0; i < 8; i++) {
+  for (int i = 0; i < REQUEST_PIN_COUNT; i++) {
     pinMode(REQUEST_PINS[i], INPUT);
   }
 }
 
+/*
+ * Modules boot on PROTOCOL_DEFAULT_ADDRESS. The free request lines are
+ * raised one at a time and the module on the raised line is moved to the
+ * next free address, so discovery only touches the default address and one
+ * address per module. Modules a reset of the master left on an assigned
+ * address are sent back to the default one first.
+ */
 void discoverModules() {
-  Serial.println("Starting I2C Discovery...");
-  
-  JsonDocument pingAction;
-  pingAction["action"] = "ping";
-  String pingCommand;
-  serializeJson(pingAction, pingCommand);
-  
-  JsonDocument enableRequestPinAction;
-  enableRequestPinAction["action"] = "erp";
-  String enableRequestPinCommand;
-  serializeJson(enableRequestPinAction, enableRequestPinCommand);
-  
-  JsonDocument disableRequestPinAction;
-  disableRequestPinAction["action"] = "drp";
-  String disableRequestPinCommand;
-  serializeJson(disableRequestPinAction, disableRequestPinCommand);
-  
-  JsonDocument identificationAction;
-  identificationAction["action"] = "ident";
-  String identificationCommand;
-  serializeJson(identificationAction, identificationCommand);
+  LOG_INFO(DISCOVERY_START);
+  reclaimAddresses();
+
+  for (int i = 0; i < REQUEST_PIN_COUNT && probeAddress(PROTOCOL_DEFAULT_ADDRESS); i++) {
+    int pin = REQUEST_PINS[i];
+    byte address = nextFreeAddress();
+    if (isAssignedPin(pin) || address == 0) {
+      continue;
+    }
+    if (assignAddress(pin, address)) {
+      sendMessage(address, IdentMessage());
+      registerModule(address, pin);
+      awaitReply(ACTIVE_MODULES - 1);
+    }
+  }
 
-  for (byte currentAddress = MODULE_START_ADDRESS; currentAddress <= MODULE_END_ADDRESS; currentAddress++) {
-    byte error = sendCommand(currentAddress, pingCommand);
+  LOG_INFO(DISCOVERY_DONE, ACTIVE_MODULES);
+  for(int i = 0; i < ACTIVE_MODULES; i++) {
+    LOG_INFO(MODULE_FOUND, i, MODULE_ADDRESSES[i], ASSIGNED_REQUEST_PINS[i]);
+  }
+}
 
-    if (error == 0) {
-      sendCommand(currentAddress, enableRequestPinCommand);
-      delay(25);
+/*
+ * Modules keep their address through a reset of the master alone (watchdog,
+ * brownout, reset button). Any module answering on the assigned range is
+ * sent back to the default address and discovered again like a new one.
+ */
+void reclaimAddresses() {
+  const int maxModules = sizeof(MODULE_ADDRESSES) / sizeof(MODULE_ADDRESSES[0]);
+  for (byte address = PROTOCOL_FIRST_ADDRESS; address < PROTOCOL_FIRST_ADDRESS + maxModules; address++) {
+    if (isKnownAddress(address) || !probeAddress(address)) {
+      continue;
+    }
+    sendMessage(address, ReleaseAddressMessage());
+    unsigned long start = millis();
+    while (probeAddress(address) && millis() - start < ASSIGN_TIMEOUT) {
+    }
+    LOG_INFO(ADDRESS_RECLAIMED, address);
+  }
+}
 
-      int pin = findRequestPin();
-      if (pin != 0) {
-        enableModule(currentAddress, pin);
-      }
+/*
+ * Drives the selected request line HIGH and the other free ones LOW while
+ * the address is sent, so only the module on that line takes it. Lines of
+ * enrolled modules are driven by the modules and left alone. The lines stay
+ * driven until the module answers on its new address or the offer times
+ * out, the caller releases them.
+ */
+void offerAddress(int requestPin, byte address) {
+  AssignAddressMessage assign;
+  assign.address = address;
+
+  selectRequestPin(requestPin);
+  sendMessage(PROTOCOL_DEFAULT_ADDRESS, assign);
+}
+
+bool assignAddress(int requestPin, byte address) {
+  offerAddress(requestPin, address);
 
-      sendCommand(currentAddress, disableRequestPinCommand);
-      delay(50);
+  bool moved = false;
+  unsigned long start = millis();
+  while (!moved && millis() - start < ASSIGN_TIMEOUT) {
+    moved = probeAddress(address);
+  }
+  releaseRequestPins();
+  return moved;
+}
 
-      sendCommand(currentAddress, identificationCommand);
-      delay(100);
-      String identData = readFromModule(currentAddress);
+void selectRequestPin(int pin) {
+  for (int i = 0; i < REQUEST_PIN_COUNT; i++) {
+    if (!isAssignedPin(REQUEST_PINS[i])) {
+      digitalWrite(REQUEST_PINS[i], REQUEST_PINS[i] == pin ? HIGH : LOW);
+      pinMode(REQUEST_PINS[i], OUTPUT);
+    }
+  }
+}
 
-      JsonDocument doc; 
-      deserializeJson(doc, identData);
+void releaseRequestPins() {
+  for (int i = 0; i < REQUEST_PIN_COUNT; i++) {
+    if (!isAssignedPin(REQUEST_PINS[i])) {
+      pinMode(REQUEST_PINS[i], INPUT);
+    }
+  }
+}
 
-      const String moduleType = doc["type"];
-      const bool needy = doc["isNeedy"];
+// The line of a failed module counts as free, its module is rebooting and does not drive it
+bool isAssignedPin(int pin) {
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (ASSIGNED_REQUEST_PINS[i] == pin && MODULE_HEALTH[i] != HEALTH_FAILED) {
+      return true;
+    }
+  }
+  return false;
+}
 
-      MODULE_TYPES[ACTIVE_MODULES - 1] = moduleType;
-      NEEDY_MODULES[ACTIVE_MODULES - 1] = needy;
-      READY_MODULES[ACTIVE_MODULES - 1] = false;
+// Lowest unused address of the module range, 0 if the roster is full
+byte nextFreeAddress() {
+  const int maxModules = sizeof(MODULE_ADDRESSES) / sizeof(MODULE_ADDRESSES[0]);
+  for (byte address = PROTOCOL_FIRST_ADDRESS; address < PROTOCOL_FIRST_ADDRESS + maxModules; address++) {
+    if (!isKnownAddress(address)) {
+      return address;
     }
   }
+  return 0;
+}
 
-  Serial.println("I2C Scan Complete.");
-  Serial.print("Found ");
-  Serial.print(ACTIVE_MODULES);
-  Serial.println(" moduled");
-  for(int i = 0; i < ACTIVE_MODULES; i++) {
-    Serial.print("Active Module #");
-    Serial.print(i);
-    Serial.print(" found @ address 0x");
-    Serial.print(MODULE_ADDRESSES[i], HEX);
-    Serial.print(" with request pin ");
-    Serial.println(ASSIGNED_REQUEST_PINS[i]);
+/*
+ * Adds the module to the roster. onIdentReply() fills in its type once the
+ * caller has read the reply, a module that does not answer stays a plain
+ * module.
+ */
+void registerModule(byte i2cAddress, int requestPin) {
+  const int maxModules = sizeof(MODULE_ADDRESSES) / sizeof(MODULE_ADDRESSES[0]);
+  if (requestPin == 0 || ACTIVE_MODULES >= maxModules) {
+    return;
+  }
+  enableModule(i2cAddress, requestPin);
+
+  MODULE_TYPES[ACTIVE_MODULES - 1] = MODULE_TYPE_NONE;
+  NEEDY_MODULES[ACTIVE_MODULES - 1] = false;
+  SOLVED_MODULES[ACTIVE_MODULES - 1] = false;
+  READY_MODULES[ACTIVE_MODULES - 1] = false;
+  PROVISIONED_MODULES[ACTIVE_MODULES - 1] = false;
+  MISSED_PINGS[ACTIVE_MODULES - 1] = 0;
+  MODULE_HEALTH[ACTIVE_MODULES - 1] = HEALTH_OK;
+  LAST_HEARD[ACTIVE_MODULES - 1] = millis();
+  BUS_KHZ[ACTIVE_MODULES - 1] = PROTOCOL_BUS_STANDARD_KHZ;
+  MAX_FRAMES[ACTIVE_MODULES - 1] = PROTOCOL_MAX_FRAME;
+}
+
+void onIdentReply(uint8_t moduleId, const IdentReplyMessage& message) {
+  MODULE_TYPES[moduleId] = message.type;
+  NEEDY_MODULES[moduleId] = message.needy;
+  SOLVED_MODULES[moduleId] = message.needy; // needy modules can't be solved
+  BUS_KHZ[moduleId] = constrain(message.maxBusKHz, PROTOCOL_BUS_STANDARD_KHZ, BUS_MAX_KHZ);
+  MAX_FRAMES[moduleId] = message.maxFrame;
+  LOG_INFO(BUS_SPEED, MODULE_ADDRESSES[moduleId], BUS_KHZ[moduleId], MAX_FRAMES[moduleId]);
+}
+
+void removeModule(int moduleId) {
+  LOG_WARN(MODULE_LOST, MODULE_ADDRESSES[moduleId]);
+
+  for (int i = moduleId; i < ACTIVE_MODULES - 1; i++) {
+    MODULE_ADDRESSES[i] = MODULE_ADDRESSES[i + 1];
+    ASSIGNED_REQUEST_PINS[i] = ASSIGNED_REQUEST_PINS[i + 1];
+    SOLVED_MODULES[i] = SOLVED_MODULES[i + 1];
+    NEEDY_MODULES[i] = NEEDY_MODULES[i + 1];
+    READY_MODULES[i] = READY_MODULES[i + 1];
+    PROVISIONED_MODULES[i] = PROVISIONED_MODULES[i + 1];
+    MODULE_TYPES[i] = MODULE_TYPES[i + 1];
+    MISSED_PINGS[i] = MISSED_PINGS[i + 1];
+    MODULE_HEALTH[i] = MODULE_HEALTH[i + 1];
+    LAST_HEARD[i] = LAST_HEARD[i + 1];
+    BUS_KHZ[i] = BUS_KHZ[i + 1];
+    MAX_FRAMES[i] = MAX_FRAMES[i + 1];
+  }
+  ACTIVE_MODULES--;
+  MODULE_ADDRESSES[ACTIVE_MODULES] = -1;
+  ASSIGNED_REQUEST_PINS[ACTIVE_MODULES] = -1;
+  SOLVED_MODULES[ACTIVE_MODULES] = true;
+  NEEDY_MODULES[ACTIVE_MODULES] = false;
+  READY_MODULES[ACTIVE_MODULES] = true;
+  PROVISIONED_MODULES[ACTIVE_MODULES] = false;
+  MODULE_TYPES[ACTIVE_MODULES] = MODULE_TYPE_NONE;
+  MISSED_PINGS[ACTIVE_MODULES] = 0;
+  MODULE_HEALTH[ACTIVE_MODULES] = HEALTH_OK;
+}
+
+bool probeAddress(byte address) {
+  selectBusSpeed(address);
+  Wire.beginTransmission(address);
+  bool answered = Wire.endTransmission() == 0;
+  noteBusResult(address, answered);
+  return answered;
+}
+
+bool isKnownAddress(byte address) {
+  return findModule(address) >= 0;
+}
+
+int findModule(byte address) {
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (MODULE_ADDRESSES[i] == address) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Hot plug while the menu is shown. A new module always shows up on
+ * PROTOCOL_DEFAULT_ADDRESS, so a single probe per HOTPLUG_PROBE_INTERVAL
+ * finds it; known modules get one liveness ping per HOTPLUG_PING_INTERVAL.
+ * Enrolling a new module is split into non-blocking steps, see
+ * continueEnrollment(). No transaction starts once HOTPLUG_BUDGET_MICROS
+ * of the pass are spent.
+ */
+void serviceHotPlug() {
+  PROFILE_SCOPE(PROFILE_HOTPLUG);
+  unsigned long start = micros();
+  while (enrollState != ENROLL_IDLE) {
+    continueEnrollment();
+    if (micros() - start >= HOTPLUG_BUDGET_MICROS) {
+      return;
+    }
+  }
+
+  bool rosterChanged = false;
+
+  // modules that failed during a game are dropped, if they rebooted they enroll again
+  for (int i = ACTIVE_MODULES - 1; i >= 0; i--) {
+    if (MODULE_HEALTH[i] == HEALTH_FAILED) {
+      removeModule(i);
+      rosterChanged = true;
+    }
+  }
+
+  if (ACTIVE_MODULES > 0 && millis() - hotPlugLastPing >= HOTPLUG_PING_INTERVAL
+      && micros() - start < HOTPLUG_BUDGET_MICROS) {
+    hotPlugLastPing = millis();
+    hotPlugPingIndex = hotPlugPingIndex % ACTIVE_MODULES;
+    if (probeAddress(MODULE_ADDRESSES[hotPlugPingIndex])) {
+      MISSED_PINGS[hotPlugPingIndex] = 0;
+    } else if (++MISSED_PINGS[hotPlugPingIndex] >= HOTPLUG_MAX_MISSED_PINGS) {
+      removeModule(hotPlugPingIndex);
+      rosterChanged = true;
+    }
+    hotPlugPingIndex++;
+  }
+
+  if (millis() - hotPlugLastProbe >= HOTPLUG_PROBE_INTERVAL && micros() - start < HOTPLUG_BUDGET_MICROS) {
+    hotPlugLastProbe = millis();
+    if (probeAddress(PROTOCOL_DEFAULT_ADDRESS)) {
+      enrollPinIndex = 0;
+      enrollState = ENROLL_ASSIGN;
+    }
+  }
+
+  if (rosterChanged) {
+    displayMenu();
+  }
+}
+
+/*
+ * Runs the same handshake as discoverModules(), one step per call: offer
+ * the next free address on the next free line, wait for the module to
+ * answer there, then identify it. The waits are polled, one transaction
+ * per call, so no call blocks for the module's loop().
+ */
+void continueEnrollment() {
+  switch (enrollState) {
+    case ENROLL_ASSIGN:
+      while (enrollPinIndex < REQUEST_PIN_COUNT && isAssignedPin(REQUEST_PINS[enrollPinIndex])) {
+        enrollPinIndex++;
+      }
+      enrollAddress = nextFreeAddress();
+      if (enrollPinIndex >= REQUEST_PIN_COUNT || enrollAddress == 0) {
+        enrollState = ENROLL_IDLE;
+        return;
+      }
+      enrollRequestPin = REQUEST_PINS[enrollPinIndex++];
+      offerAddress(enrollRequestPin, enrollAddress);
+      enrollState = ENROLL_CONFIRM;
+      enrollTimer = millis();
+      break;
+    case ENROLL_CONFIRM:
+      if (probeAddress(enrollAddress)) {
+        releaseRequestPins();
+        sendMessage(enrollAddress, IdentMessage());
+        registerModule(enrollAddress, enrollRequestPin);
+        enrollState = ENROLL_READ;
+        enrollTimer = millis();
+      } else if (millis() - enrollTimer >= ASSIGN_TIMEOUT) {
+        releaseRequestPins();
+        enrollState = ENROLL_ASSIGN;
+      }
+      break;
+    case ENROLL_READ: {
+      int moduleId = findModule(enrollAddress);
+      if (moduleId < 0 || readFromModule(moduleId) || millis() - enrollTimer >= REPLY_TIMEOUT) {
+        enrollState = ENROLL_IDLE;
+        displayMenu();
+      }
+      break;
+    }
   }
 }
 
@@ -364,32 +815,38 @@ int findRequestPin() {
   return 0;
 }
 
-byte sendCommand(byte address, String command) {
-  int commandLength = command.length();
-  for (int i = 0; i < commandLength; i += 32) {
-    String chunk = command.substring(i, min(i + 32, commandLength));
-      Wire.beginTransmission(address);
-      Wire.print(chunk);
-      Wire.endTransmission();
-      delay(10); // Short delay to ensure the slave can process the data
+byte sendFrame(byte address, const uint8_t* frame, uint8_t length) {
+  int moduleId = findModule(address);
+  if (moduleId >= 0 && length > MAX_FRAMES[moduleId]) {
+    LOG_WARN(FRAME_TOO_LONG, length, address);
+    return 1; // same as Wire's "data too long"
   }
-  Serial.print("Sent command to 0x");
-  Serial.println(address, HEX);
+
+  selectBusSpeed(address);
   Wire.beginTransmission(address);
-  Wire.print('\0');
-  return Wire.endTransmission();
+  Wire.write(frame, length);
+  LOG_DEBUG(COMMAND_SENT, length, address);
+  byte error = Wire.endTransmission();
+  noteBusResult(address, error == 0);
+  return error;
+}
+
+template <typename Message>
+byte sendMessage(byte address, const Message& message) {
+  uint8_t frame[PROTOCOL_MAX_FRAME];
+  uint8_t length = protocolEncode(message, frame);
+  return sendFrame(address, frame, length);
 }
 
 void enableModule(byte i2cAddress, int requestPin) {
-  Serial.println("enabled");
+  LOG_DEBUG(MODULE_ENABLED, i2cAddress);
   MODULE_ADDRESSES[ACTIVE_MODULES] = i2cAddress;
   ASSIGNED_REQUEST_PINS[ACTIVE_MODULES] = requestPin;
   ACTIVE_MODULES++;
 }
 
 void incomingRequest() {
-  Serial.print("Interrupt received from pin ");
-  Serial.println(findRequestPin());
+  LOG_DEBUG(REQUEST_INTERRUPT, findRequestPin());
   scanForRequest = true;
 }
 
@@ -399,47 +856,180 @@ void enableModuleInterrupt() {
 }
 
 void doScanForRequests(bool alwaysCheck) {
+  PROFILE_SCOPE(PROFILE_SCAN_REQUESTS);
   if (scanForRequest || alwaysCheck) {
     for (int i = 0; i < 8; i++) {
       if (digitalRead(ASSIGNED_REQUEST_PINS[i]) == HIGH) {
-        String command = readFromModule(MODULE_ADDRESSES[i]);
-        
-        JsonDocument doc; 
-        deserializeJson(doc, command);
-
-        const String action = doc["action"];
-
-        if (action == "solved") {
-          markModuleAsSolved(i);
-        } else if (action == "mistake") {
-          addMistakeFromModule(i);
-        } else if (action == "ready") {
-          READY_MODULES[i] = true;
-        }
+        readFromModule(i);
       }
     }
     scanForRequest = false;
   }
 }
 
-String readFromModule(int address)
+/*
+ * Reads the frame a module has queued in a single request and hands it to
+ * the matching on<Name>() handler. Returns false if nothing valid was read.
+ */
+bool readFromModule(int moduleId)
 {
-  String returnValue = "";
-  bool keepTransmission = true;
-  while(keepTransmission) {
-    Wire.requestFrom(address, 6, false);
-    while(Wire.available())
-    { 
-      char c = Wire.read();
-      if (c == '\0') {
-        keepTransmission = false;
-      }
-      if (keepTransmission) {
-        returnValue += c;
+  uint8_t frame[PROTOCOL_MAX_UPLINK_FRAME];
+  selectBusSpeed(MODULE_ADDRESSES[moduleId]);
+  uint8_t received = Wire.requestFrom(MODULE_ADDRESSES[moduleId], (int) PROTOCOL_MAX_UPLINK_FRAME);
+  noteBusResult(MODULE_ADDRESSES[moduleId], received > 0);
+  uint8_t length = protocolReceiveUplink(Wire, frame);
+  if (protocolDispatchUplink(moduleId, frame, length)) {
+    return true;
+  }
+  if (length > 0 && frame[0] != PROTOCOL_OP_NONE) {
+    slowDownModule(moduleId); // corrupted frame
+  }
+  return false;
+}
+
+/*
+ * Every answered transaction doubles as a heartbeat, so modules that talk
+ * to the master during the game are never probed separately. An unanswered
+ * one costs the module its fast mode. Wire aborts and resets a transaction
+ * stuck for longer than BUS_TIMEOUT_MICROS.
+ */
+void noteBusResult(byte address, bool answered) {
+  if (Wire.getWireTimeoutFlag()) {
+    Wire.clearWireTimeoutFlag();
+    LOG_WARN(BUS_TIMEOUT, address);
+  }
+  int moduleId = findModule(address);
+  if (moduleId < 0) {
+    return;
+  }
+  if (!answered) {
+    slowDownModule(moduleId);
+    return;
+  }
+  LAST_HEARD[moduleId] = millis();
+  MISSED_PINGS[moduleId] = 0;
+  MODULE_HEALTH[moduleId] = HEALTH_OK;
+}
+
+/*
+ * The TWI clock follows the module being talked to, at the speed agreed in
+ * its IdentReply. Unknown addresses get standard mode.
+ */
+void selectBusSpeed(byte address) {
+  int moduleId = findModule(address);
+  uint16_t kHz = moduleId >= 0 ? BUS_KHZ[moduleId] : PROTOCOL_BUS_STANDARD_KHZ;
+  if (kHz != busKHz) {
+    Wire.setClock(kHz * 1000UL);
+    busKHz = kHz;
+  }
+}
+
+// A failed transaction above standard mode keeps the module in standard mode until it registers again
+void slowDownModule(int moduleId) {
+  if (BUS_KHZ[moduleId] > PROTOCOL_BUS_STANDARD_KHZ) {
+    BUS_KHZ[moduleId] = PROTOCOL_BUS_STANDARD_KHZ;
+    LOG_WARN(BUS_FALLBACK, MODULE_ADDRESSES[moduleId], PROTOCOL_BUS_STANDARD_KHZ);
+  }
+}
+
+/*
+ * Failure detection during a game. Modules silent for HEARTBEAT_SILENCE get
+ * an address-only probe, one per SUPERVISION_INTERVAL. A missed probe makes
+ * a module suspect, HOTPLUG_MAX_MISSED_PINGS in a row make it failed. A
+ * failed module that rebooted waits on the default address and is put back
+ * by recoverModule().
+ */
+void superviseModules() {
+  if (ACTIVE_MODULES == 0 || millis() - supervisionLastCheck < SUPERVISION_INTERVAL) {
+    return;
+  }
+  supervisionLastCheck = millis();
+
+  int failed = -1;
+  for (int n = 0; n < ACTIVE_MODULES; n++) {
+    supervisionIndex = (supervisionIndex + 1) % ACTIVE_MODULES;
+    if (MODULE_HEALTH[supervisionIndex] == HEALTH_FAILED) {
+      failed = supervisionIndex;
+    } else if (millis() - LAST_HEARD[supervisionIndex] >= HEARTBEAT_SILENCE) {
+      if (!probeAddress(MODULE_ADDRESSES[supervisionIndex])) {
+        missHeartbeat(supervisionIndex);
       }
+      return;
+    }
+  }
+
+  if (failed >= 0 && probeAddress(PROTOCOL_DEFAULT_ADDRESS)) {
+    recoverModule(failed);
+  }
+}
+
+void missHeartbeat(int moduleId) {
+  if (++MISSED_PINGS[moduleId] >= HOTPLUG_MAX_MISSED_PINGS) {
+    MODULE_HEALTH[moduleId] = HEALTH_FAILED;
+    LOG_WARN(MODULE_FAILED, MODULE_ADDRESSES[moduleId]);
+  } else if (MODULE_HEALTH[moduleId] == HEALTH_OK) {
+    MODULE_HEALTH[moduleId] = HEALTH_SUSPECT;
+    LOG_INFO(MODULE_SUSPECT, MODULE_ADDRESSES[moduleId]);
+  }
+}
+
+/*
+ * A rebooted module has lost its address and its game. It is moved back to
+ * its old address and provisioned with the running game, so its id and the
+ * master's bookkeeping stay valid. A running needy timer stays with the
+ * master and still expires, the module only misses the activation.
+ */
+void recoverModule(int moduleId) {
+  unsigned long start = millis();
+  if (!assignAddress(ASSIGNED_REQUEST_PINS[moduleId], MODULE_ADDRESSES[moduleId])) {
+    return;
+  }
+
+  ProvisionMessage provision;
+  fillProvision(provision);
+  sendMessage(MODULE_ADDRESSES[moduleId], provision);
+  READY_MODULES[moduleId] = false;
+
+  LOG_INFO(MODULE_RECOVERED, MODULE_ADDRESSES[moduleId], millis() - start);
+}
+
+// delay() for blocking screens, keeps the watchdog fed
+void watchdogDelay(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) {
+    wdt_reset();
+  }
+}
+
+/*
+ * Modules handle commands in their loop(), so the reply to a command that
+ * was just sent may not be queued yet. Reads until it is.
+ */
+bool awaitReply(int moduleId)
+{
+  unsigned long start = millis();
+  do {
+    if (readFromModule(moduleId)) {
+      return true;
     }
+  } while (millis() - start < REPLY_TIMEOUT);
+  return false;
+}
+
+void onReady(uint8_t moduleId, const ReadyMessage& message) {
+  READY_MODULES[moduleId] = true;
+}
+
+void onMistake(uint8_t moduleId, const MistakeMessage& message) {
+  addMistakeFromModule(moduleId);
+}
+
+void onSolved(uint8_t moduleId, const SolvedMessage& message) {
+  if (NEEDY_MODULES[moduleId]) {
+    calmNeedyModule(moduleId);
+  } else {
+    markModuleAsSolved(moduleId);
   }
-  return returnValue;
 }
 
 void initializeSerialDisplay() {
@@ -466,7 +1056,7 @@ void displaySerialNumber() {
   serialDisplay.setTextColor(GxEPD_WHITE);
   serialDisplay.setFont(&FreeMonoBold24pt7b);
   serialDisplay.setCursor(11, 72); // 47h 224w
-  serialDisplay.print(serialNumber);
+  serialDisplay.print(edgework.serial);
   serialDisplay.nextPage();
 }
 
@@ -476,13 +1066,14 @@ void blankSerialNumber() {
 }
 
 void initializeMenuDisplay() {
-  pinMode(ROTENC_BTN, INPUT);
+  Input.begin(ROTENC_A, ROTENC_B, ROTENC_BTN);
   menuDisplay.init(240, 320); // Init ST7789 320x240
   menuDisplay.setRotation(MENU_DISPLAY_ROTATION);
   menuDisplay.fillScreen(ST77XX_BLACK);
 }
 
 void displayMenu() {
+  PROFILE_SCOPE(PROFILE_DISPLAY_MENU);
   menuDisplay.fillRect(0, 0, 20, 240, ST77XX_BLACK);
 
   menuDisplay.setTextWrap(false);
@@ -541,6 +1132,13 @@ void displayMenu() {
   menuDisplay.println(displayTime);
 
   
+  menuDisplay.setCursor(30, 70);
+  menuDisplay.setTextColor(ST77XX_WHITE);
+  menuDisplay.println("Modules:");
+  menuDisplay.fillRect(240, 80, 80, 20, ST77XX_BLACK);
+  menuDisplay.setCursor(ACTIVE_MODULES >= 10 ? 284 : 296, 70);
+  menuDisplay.println(ACTIVE_MODULES);
+
   menuDisplay.setCursor(30, 200);
   menuDisplay.println("START");
 }
@@ -559,89 +1157,202 @@ String getTimeForDisplay() {
 
 
 void setupGame() {
-  generateSerialNumber();
-  generateLabels();
-  generateBatteries();
-  generatePorts();
+  randomnessSeed = random();
+  edgeworkGenerate(randomnessSeed, edgework);
+  resetGameState();
+}
+
+/*
+ * Everything that belongs to a single game. Reset in place, so a rematch
+ * keeps the module roster from discovery and hot plug.
+ */
+void resetGameState() {
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    SOLVED_MODULES[i] = NEEDY_MODULES[i]; // needy modules can't be solved
+    READY_MODULES[i] = false;
+  }
+  for (int i = 0; i < 3; i++) {
+    MISTAKE_TRACE[i] = -1;
+  }
   currentLives = baseLives;
-  currentTime = baseTime + 1;
+  consumedQuarterMillis = 0;
+  gameResult = GAME_RUNNING;
+  scanForRequest = false;
+  clockTicked = false;
+  digitalWrite(MISTAKE_A_LED, LOW);
+  digitalWrite(MISTAKE_B_LED, LOW);
 }
 
+/*
+ * Modules that were provisioned for an earlier game derive the edgework from
+ * the new seed themselves and only get a Rematch with the settings that
+ * changed. Modules that joined since get the full Provision.
+ */
 void provisionModules() {
-  JsonDocument provision;
-  provision["action"] = "provision";
-  provision["data"]["serial"] = serialNumber;
-  provision["data"]["lives"] = baseLives;
-  provision["data"]["time"] = baseTime;
-  provision["data"]["seed"] = randomnessSeed;
-  provision["data"]["ports"]["VGA"] = portCountVGA;
-  provision["data"]["ports"]["RJ45"] = portCountRJ45;
-  provision["data"]["ports"]["RCA"] = portCountRCA;
-  provision["data"]["ports"]["PS2"] = portCountPS2;
-  provision["data"]["batteries"]["AA"] = batteryCountAA;
-  provision["data"]["batteries"]["D"] = batteryCountD;
-  for (int i = 0; i < generatedLabelCount; i++) {
-    provision["data"]["labels"][i]["label"] = bombLabels[i].label;
-    provision["data"]["labels"][i]["lit"] = bombLabels[i].lit;
+  ProvisionMessage provision;
+  fillProvision(provision);
+
+  RematchMessage rematch;
+  rematch.seed = randomnessSeed;
+  rematch.changed = 0;
+  if (baseLives != provisionedLives) {
+    rematch.changed |= PROTOCOL_REMATCH_LIVES;
   }
-  
-  String provisionCommand;
-  serializeJson(provision, provisionCommand);
+  if (baseTime != provisionedTime) {
+    rematch.changed |= PROTOCOL_REMATCH_TIME;
+  }
+  rematch.lives = baseLives;
+  rematch.time = baseTime;
 
-  broadcastToAllModules(provisionCommand);
+  int provisioned = 0;
+  int rematched = 0;
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (PROVISIONED_MODULES[i]) {
+      sendMessage(MODULE_ADDRESSES[i], rematch);
+      rematched++;
+    } else if (sendMessage(MODULE_ADDRESSES[i], provision) == 0) {
+      PROVISIONED_MODULES[i] = true;
+      provisioned++;
+    }
+  }
+  provisionedLives = baseLives;
+  provisionedTime = baseTime;
 
-  Serial.println(provisionCommand);
+  if (provisioned > 0) {
+    LOG_INFO(PROVISION_SENT, ProvisionMessage::FRAME_LENGTH);
+  }
+  if (rematched > 0) {
+    LOG_INFO(REMATCH_SENT, rematched, rematch.changed);
+  }
 }
 
-void generateLabels() {
-  int labelsToGenerate = random(0, maxLabels);
-  labelsToGenerate = 4;
-  
-  int usedLabels[4] = {-1, -1, -1, -1};
-  for (int i = 0; i < labelsToGenerate; i++) {
-      int labelIndex = random(0, 11);
-      while (intIssetInArray(usedLabels, labelIndex)) {
-        labelIndex = random(0, 11);
-      }
-      String label = possibleLabels[labelIndex];
-      bombLabels[i].label = label;
-      bombLabels[i].lit = random(0, 1023) % 3 == 1 ? true : false;
-      generatedLabelCount++;
+void fillProvision(ProvisionMessage& provision) {
+  memcpy(provision.serial, edgework.serial, SERIAL_NUMBER_LENGTH);
+  for (int i = 0; i < PROTOCOL_MAX_LABELS; i++) {
+    provision.labels[i] = i < edgework.labelCount ? protocolPackLabel(edgework.labels[i]) : PROTOCOL_LABEL_NONE;
   }
+  provision.lives = baseLives;
+  provision.time = getRemainingMillis() / 1000;
+  provision.seed = randomnessSeed;
+  memcpy(provision.ports, edgework.ports, PORT_COUNT);
+  memcpy(provision.batteries, edgework.batteries, BATTERY_COUNT);
 }
 
-bool intIssetInArray(int haystack[], int search) {
-  int size = 0;
-  for (int i = 0; haystack[i]; i++) {
-    size++;
+/*
+ * Picks up a game that was running when the master lost power. The seed
+ * gives back the edgework and every module's puzzle, so the modules only
+ * need a Provision with the time that was left. Only resumes with the same
+ * modules on the same request lines. Module ids depend on discovery and hot
+ * plug order, so the snapshot refers to modules by request line.
+ */
+bool resumeGame() {
+  GameSnapshot snapshot;
+  if (!Snapshots.load(snapshot) || !snapshot.running) {
+    return false;
+  }
+  if (snapshot.rosterMask != rosterMask()) {
+    LOG_WARN(RESUME_REFUSED, Snapshots.sequence(), snapshot.rosterMask, rosterMask());
+    return false;
   }
 
-  for (int j = 0; j < size; j++) {
-    if (haystack[j] == search) {
-      return true;
+  baseLives = snapshot.baseLives;
+  baseTime = snapshot.baseTime;
+  randomnessSeed = snapshot.seed;
+  edgeworkGenerate(randomnessSeed, edgework);
+  resetGameState();
+
+  currentLives = snapshot.currentLives;
+  consumedQuarterMillis = snapshot.consumedQuarterMillis;
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (snapshot.solvedMask & (1 << requestLineOf(i))) {
+      SOLVED_MODULES[i] = true;
     }
   }
-  return false;
+  for (int i = 0; i < 3; i++) {
+    MISTAKE_TRACE[i] = moduleOnRequestLine(snapshot.mistakeTrace[i]);
+  }
+  digitalWrite(MISTAKE_A_LED, baseLives - currentLives >= 1 ? HIGH : LOW);
+  digitalWrite(MISTAKE_B_LED, baseLives - currentLives >= 2 ? HIGH : LOW);
+
+  displayTextOnMenuDisplay(F("Resuming"));
+  provisionModules();
+  initializeClock();
+  resuming = true;
+
+  LOG_INFO(GAME_RESUMED, Snapshots.sequence(), getRemainingMillis() / 1000, baseLives - currentLives);
+  return true;
 }
 
-void generateBatteries() {
-  batteryCountAA = random(0, maxBatteriesAA);
-  batteryCountD = random(0, min(maxBatteriesTotal - batteryCountAA, maxBatteriesD));
+// Written to EEPROM from loop() by Snapshots.service(), usually as a short journal step
+void saveSnapshot(bool running) {
+  GameSnapshot snapshot = {};
+  snapshot.seed = randomnessSeed;
+  snapshot.consumedQuarterMillis = consumedQuarterMillis;
+  snapshot.baseTime = baseTime;
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (SOLVED_MODULES[i]) {
+      snapshot.solvedMask |= 1 << requestLineOf(i);
+    }
+  }
+  snapshot.running = running;
+  snapshot.baseLives = baseLives;
+  snapshot.currentLives = currentLives;
+  snapshot.rosterMask = rosterMask();
+  for (int i = 0; i < 3; i++) {
+    snapshot.mistakeTrace[i] = MISTAKE_TRACE[i] < 0 ? -1 : requestLineOf(MISTAKE_TRACE[i]);
+  }
+
+  Snapshots.save(snapshot);
+  lastSnapshot = millis();
 }
 
-void generatePorts() {
-  portCountVGA = random(0, maxPortsPerType);
-  portCountPS2 = random(0, min(maxPortsPerType, maxPortsTotal - portCountVGA));
-  portCountRJ45 = random(0, min(maxPortsPerType, maxPortsTotal - portCountVGA - portCountPS2));
-  portCountRCA = random(0, min(maxPortsPerType, maxPortsTotal - portCountVGA - portCountPS2 - portCountRJ45));
+uint8_t rosterMask() {
+  uint8_t mask = 0;
+  for (int i = 0; i < REQUEST_PIN_COUNT; i++) {
+    if (isAssignedPin(REQUEST_PINS[i])) {
+      mask |= 1 << i;
+    }
+  }
+  return mask;
+}
+
+int requestLineOf(int moduleId) {
+  for (int i = 0; i < REQUEST_PIN_COUNT; i++) {
+    if (REQUEST_PINS[i] == ASSIGNED_REQUEST_PINS[moduleId]) {
+      return i;
+    }
+  }
+  return -1;
 }
 
-void broadcastToAllModules(String command) {
+int moduleOnRequestLine(int line) {
+  if (line < 0 || line >= REQUEST_PIN_COUNT) {
+    return -1;
+  }
   for (int i = 0; i < ACTIVE_MODULES; i++) {
-    if (MODULE_ADDRESSES[i] == 0xFF) { continue; }
-    sendCommand(MODULE_ADDRESSES[i], command);
+    if (ASSIGNED_REQUEST_PINS[i] == REQUEST_PINS[line]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Game over screen: a press replays right away with the same modules and
+ * settings, turning the knob goes back to the menu to change them first.
+ */
+void checkRematch() {
+  if (Input.takePresses() > 0) {
+    blankMenuDisplay();
+    globalState = 3;
+  } else if (Input.takeSteps().steps != 0) {
+    blankMenuDisplay();
+    selectedMenuPosition = 0;
+    displayMenu();
+    globalState = 2;
   }
 }
+
 void initializeLabelDisplays() {
   const size_t n = sizeof(LABEL_PINS) / sizeof(LABEL_PINS[0]);
 
@@ -669,79 +1380,57 @@ void displayLabels() {
     LABEL_DISPLAYS[i]->setTextSize(7);
     LABEL_DISPLAYS[i]->setTextColor(ST77XX_BLACK);
     LABEL_DISPLAYS[i]->setCursor(20, 20);
-    if (generatedLabelCount >= i) {
-      LABEL_DISPLAYS[i]->println(bombLabels[i].label);
-      if (bombLabels[i].lit) {
+    if (edgework.labelCount >= i) {
+      LABEL_DISPLAYS[i]->println(labelName(edgework.labels[i].label));
+      if (edgework.labels[i].lit) {
         digitalWrite(LABEL_LED_PINS[i], HIGH);
       }
     }
   }
 }
   
+/*
+ * Applies every detent turned since the last call, however long the previous
+ * redraw took. The time setting uses the accelerated count.
+ */
 void checkRotEnc() {
-  encoder.tick();
-  int newPos = encoder.getPosition();
-  if (globalPos != newPos) {
-    int direction = (globalPos > newPos ? -1 : 1);
-    if (selectedMenuPosition == 0) {
-      int newCursorPosition = menuCursorPosition + direction;
-      if (newCursorPosition <= 1) {
-        menuCursorPosition = 1;
-      } else if (newCursorPosition >= 3) {
-        menuCursorPosition = 3;
-      } else {
-        menuCursorPosition = newCursorPosition;
-      }
-    } else if (selectedMenuPosition == 1) {
-      if (baseLives == 1 && direction == 1) {
-        baseLives = 3;
-      } else if (baseLives == 3 && direction == -1) {
-        baseLives = 1;
-      }
-    } else if (selectedMenuPosition == 2) {
-      if (direction == -1) {
-        baseTime -= 30;
-      } else if (direction == 1) {
-        baseTime += 30;
-      }
-      if (baseTime <= 60) {
-        baseTime = 60;
-      }
-      if (baseTime >= 900) {
-        baseTime = 900;
-      }
+  PROFILE_SCOPE(PROFILE_CHECK_ROTENC);
+  EncoderDelta delta = Input.takeSteps();
+  if (delta.steps == 0) {
+    return;
+  }
 
+  if (selectedMenuPosition == 0) {
+    menuCursorPosition = constrain(menuCursorPosition + delta.steps, 1, 3);
+  } else if (selectedMenuPosition == 1) {
+    if (baseLives == 1 && delta.steps > 0) {
+      baseLives = 3;
+    } else if (baseLives == 3 && delta.steps < 0) {
+      baseLives = 1;
     }
-    globalPos = newPos;
-    displayMenu();
+  } else if (selectedMenuPosition == 2) {
+    baseTime = constrain(baseTime + 30 * delta.acceleratedSteps, 60, 900);
   }
+  displayMenu();
 }
 
 void checkRotEncButton() {
-   int reading = digitalRead(ROTENC_BTN);
-  if (reading != rotEncLastButtonState) {
-    rotEncLastDebounceTime = millis();
-  }
-
-  if ((millis() - rotEncLastDebounceTime) > rotEncDebounceDelay) {
-    if (reading != rotEncButtonState) {
-      rotEncButtonState = reading;
-      if (rotEncButtonState == LOW) {
-        if (selectedMenuPosition == 0) {
-        selectedMenuPosition = menuCursorPosition;
-        } else {
-          selectedMenuPosition = 0;
-        }
-        if (selectedMenuPosition == 3) {
-          globalState = 3;
-          menuDisplay.fillRect(0, 0, 320, 240, ST77XX_BLACK);
-        } else {
-          displayMenu();
-        }
-      }
-    }
+  PROFILE_SCOPE(PROFILE_CHECK_ROTENC_BUTTON);
+  if (Input.takePresses() == 0) {
+    return;
+  }
+
+  if (selectedMenuPosition == 0) {
+    selectedMenuPosition = menuCursorPosition;
+  } else {
+    selectedMenuPosition = 0;
+  }
+  if (selectedMenuPosition == 3) {
+    globalState = 3;
+    menuDisplay.fillRect(0, 0, 320, 240, ST77XX_BLACK);
+  } else {
+    displayMenu();
   }
-  rotEncLastButtonState = reading;
 }
 
 void blankMenuDisplay()
@@ -749,9 +1438,10 @@ void blankMenuDisplay()
   menuDisplay.fillRect(0, 0, 320, 240, ST77XX_BLACK);
 }
 
-void displayTextOnMenuDisplay(String message)
+void displayTextOnMenuDisplay(const __FlashStringHelper* message)
 {
-  int messageLength = message.length();
+  PROFILE_SCOPE(PROFILE_DISPLAY_TEXT);
+  int messageLength = strlen_P(reinterpret_cast<const char*>(message));
   int letterWidth = 18;
 
   menuDisplay.fillRect(0, 0, 320, 240, ST77XX_BLACK);
@@ -780,7 +1470,7 @@ void checkSolved()
     }
   }
   if (solved) {
-    gameResult = "success";
+    gameResult = GAME_DEFUSED;
     globalState = 8;
   }
 }
@@ -788,11 +1478,85 @@ void checkSolved()
 void initializeClock()
 {
   Timer5.initialize(1000000);
+  Timer5.attachInterrupt(clockTick);
+
+  // Serial1 RX shares pin 19 with the encoder button, only TX is used
+  Serial1.begin(CLOCK_SYNC_BAUD);
+  UCSR1B &= ~_BV(RXEN1);
+}
+
+void clockTick()
+{
+  clockTicked = true;
 }
 
 void startClock()
 {
+  lastTimeUpdate = millis();
   Timer5.pwm(CLOCK_PIN, 100);
+  sendClockSync(true);
+  sendTimeSync();
+}
+
+void updateGameTime()
+{
+  unsigned long now = millis();
+  consumedQuarterMillis += (now - lastTimeUpdate) * clockSyncRate(baseLives - currentLives);
+  lastTimeUpdate = now;
+
+  if (getRemainingMillis() == 0) {
+    gameResult = GAME_EXPLODED;
+    Audio.playFile("BOOM.RAW");
+    globalState = 8;
+  } else if (now - lastClockSync >= CLOCK_SYNC_INTERVAL) {
+    sendClockSync(true);
+  }
+}
+
+unsigned long getRemainingMillis()
+{
+  unsigned long consumed = consumedQuarterMillis / CLOCK_SYNC_RATE_BASE;
+  unsigned long total = baseTime * 1000UL;
+  return consumed >= total ? 0 : total - consumed;
+}
+
+/*
+ * Running is passed in rather than read from globalState: startClock() sends
+ * the first frame from state 5, before the game loop state is entered.
+ */
+void sendClockSync(bool running)
+{
+  ClockSync sync;
+  sync.flags = 0;
+  if (running) {
+    sync.flags |= CLOCK_SYNC_RUNNING;
+  } else if (gameResult == GAME_EXPLODED) {
+    sync.flags |= CLOCK_SYNC_EXPLODED;
+  } else if (gameResult == GAME_DEFUSED) {
+    sync.flags |= CLOCK_SYNC_DEFUSED;
+  }
+  sync.strikes = baseLives - currentLives;
+  sync.remainingMillis = getRemainingMillis();
+
+  uint8_t frame[CLOCK_SYNC_FRAME_SIZE];
+  Serial1.write(frame, clockSyncEncode(sync, frame));
+  lastClockSync = millis();
+}
+
+/*
+ * Modules judge timed input against the time the clock shows. They get it
+ * whenever its rate changes and count on from there on the clock tick.
+ */
+void sendTimeSync()
+{
+  TimeSyncMessage sync;
+  sync.remainingMillis = getRemainingMillis();
+  sync.strikes = baseLives - currentLives;
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (!NEEDY_MODULES[i] && !SOLVED_MODULES[i]) {
+      sendMessage(MODULE_ADDRESSES[i], sync);
+    }
+  }
 }
 
 void stopClock()
@@ -820,23 +1584,34 @@ void enableMistakeLED()
 void markModuleAsSolved(int moduleId)
 {
   SOLVED_MODULES[moduleId] = true;
+  saveSnapshot(true);
   checkSolved();
 }
 
 void addMistakeFromModule(int moduleId)
 {
+  if (currentLives <= 0) {
+    return;
+  }
   currentLives--;
   int mistakeCount = baseLives - currentLives;
 
-  MISTAKE_TRACE[mistakeCount - 1] = moduleId;
+  if (mistakeCount <= (int) (sizeof(MISTAKE_TRACE) / sizeof(MISTAKE_TRACE[0]))) {
+    MISTAKE_TRACE[mistakeCount - 1] = moduleId;
+  }
+  saveSnapshot(true);
   enableMistakeLED();
+  Audio.play(AUDIO_CLIP_STRIKE);
+  sendClockSync(true);
+  sendTimeSync();
   checkMistakes();
 }
 
 void checkMistakes()
 {
   if (currentLives == 0) {
-    gameResult = "failed";
+    gameResult = GAME_EXPLODED;
+    Audio.playFile("BOOM.RAW");
     globalState = 8;
   }
 }
@@ -849,4 +1624,66 @@ bool checkReady()
     }
   }
   return true;
-}
\ No newline at end of file
+}
+
+void initializeAudio()
+{
+  if (!Audio.begin(SD_CS_PIN)) {
+    LOG_WARN(AUDIO_NO_SD);
+    return;
+  }
+  Audio.preload(AUDIO_CLIP_TICK, "TICK.RAW");
+  Audio.preload(AUDIO_CLIP_STRIKE, "STRIKE.RAW");
+}
+
+void startNeedyModules()
+{
+  needyScheduler.begin(randomnessSeed, millis());
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (NEEDY_MODULES[i]) {
+      needyScheduler.add(i);
+    }
+  }
+}
+
+void activateNeedyModule(uint8_t moduleId, uint16_t seconds)
+{
+  NeedyActivateMessage activate;
+  activate.seconds = seconds;
+  sendMessage(MODULE_ADDRESSES[moduleId], activate);
+}
+
+void deactivateNeedyModule(uint8_t moduleId)
+{
+  sendMessage(MODULE_ADDRESSES[moduleId], NeedyDeactivateMessage());
+}
+
+/*
+ * NeedyScheduler::update() catches up on every deadline a long pass missed,
+ * so several may expire at once, also after the game has already ended.
+ */
+void expireNeedyModule(uint8_t moduleId)
+{
+  deactivateNeedyModule(moduleId);
+  if (globalState == 7 && currentLives > 0) {
+    addMistakeFromModule(moduleId);
+  }
+}
+
+void calmNeedyModule(int moduleId)
+{
+  if (needyScheduler.isActive(moduleId)) {
+    needyScheduler.calmed(moduleId);
+    deactivateNeedyModule(moduleId);
+  }
+}
+
+void stopNeedyModules()
+{
+  for (int i = 0; i < ACTIVE_MODULES; i++) {
+    if (needyScheduler.isActive(i)) {
+      deactivateNeedyModule(i);
+    }
+  }
+  needyScheduler.reset();
+}
@@ -0,0 +1,215 @@
+#include "PuzzleEngine.h"
+
+static const uint8_t NO_WIRE = 0xFF;
+
+void PuzzleEngine::begin(uint32_t seed, const Edgework& edgework)
+{
+  uint32_t state = (seed ^ PUZZLE_SEED_SALT) != 0 ? seed ^ PUZZLE_SEED_SALT : 1;
+  isSolved = false;
+
+  layoutWires(state);
+  solveWires(edgework);
+  layoutButton(state);
+  solveButton(edgework);
+}
+
+/*
+ * Cutting the solution wire solves the module, any other wire strikes.
+ */
+PuzzleOutcome PuzzleEngine::cut(uint8_t wire)
+{
+  if (isSolved || wire >= wires) {
+    return PUZZLE_NOTHING;
+  }
+  PuzzleOutcome outcome = (PuzzleOutcome) wireOutcomes[wire];
+  isSolved = outcome == PUZZLE_SOLVED;
+  return outcome;
+}
+
+/*
+ * A tap is right when the button must not be held. A hold is right when it
+ * is released while the timer shows the strip's digit anywhere.
+ */
+PuzzleOutcome PuzzleEngine::release(uint32_t heldMillis, uint16_t remainingSeconds)
+{
+  if (isSolved) {
+    return PUZZLE_NOTHING;
+  }
+  bool tapped = heldMillis < PUZZLE_TAP_MILLIS;
+  bool correct = hold ? !tapped && timeShowsDigit(remainingSeconds, releaseDigit) : tapped;
+  isSolved = correct;
+  return correct ? PUZZLE_SOLVED : PUZZLE_STRIKE;
+}
+
+void PuzzleEngine::layoutWires(uint32_t& state)
+{
+  wires = PUZZLE_MIN_WIRES + edgeworkRandom(state, PUZZLE_MAX_WIRES - PUZZLE_MIN_WIRES + 1);
+  for (uint8_t i = 0; i < wires; i++) {
+    wireColors[i] = edgeworkRandom(state, WIRE_COLOR_COUNT);
+  }
+}
+
+void PuzzleEngine::solveWires(const Edgework& edgework)
+{
+  const uint8_t last = wires - 1;
+  const uint8_t lastColor = wireColors[last];
+  const bool odd = serialOdd(edgework);
+  const uint8_t red = countWires(WIRE_RED);
+  const uint8_t blue = countWires(WIRE_BLUE);
+  const uint8_t yellow = countWires(WIRE_YELLOW);
+  const uint8_t white = countWires(WIRE_WHITE);
+  const uint8_t black = countWires(WIRE_BLACK);
+
+  switch (wires) {
+    case 3:
+      if (red == 0) {
+        cutWire = 1;
+      } else if (lastColor == WIRE_WHITE) {
+        cutWire = last;
+      } else if (blue > 1) {
+        cutWire = lastWire(WIRE_BLUE);
+      } else {
+        cutWire = last;
+      }
+      break;
+    case 4:
+      if (red > 1 && odd) {
+        cutWire = lastWire(WIRE_RED);
+      } else if (lastColor == WIRE_YELLOW && red == 0) {
+        cutWire = 0;
+      } else if (blue == 1) {
+        cutWire = 0;
+      } else if (yellow > 1) {
+        cutWire = last;
+      } else {
+        cutWire = 1;
+      }
+      break;
+    case 5:
+      if (lastColor == WIRE_BLACK && odd) {
+        cutWire = 3;
+      } else if (red == 1 && yellow > 1) {
+        cutWire = 0;
+      } else if (black == 0) {
+        cutWire = 1;
+      } else {
+        cutWire = 0;
+      }
+      break;
+    default:
+      if (yellow == 0 && odd) {
+        cutWire = 2;
+      } else if (yellow == 1 && white > 1) {
+        cutWire = 3;
+      } else if (red == 0) {
+        cutWire = last;
+      } else {
+        cutWire = 3;
+      }
+      break;
+  }
+
+  for (uint8_t i = 0; i < wires; i++) {
+    wireOutcomes[i] = i == cutWire ? PUZZLE_SOLVED : PUZZLE_STRIKE;
+  }
+}
+
+void PuzzleEngine::layoutButton(uint32_t& state)
+{
+  button = edgeworkRandom(state, BUTTON_COLOR_COUNT);
+  label = edgeworkRandom(state, BUTTON_LABEL_COUNT);
+  strip = edgeworkRandom(state, BUTTON_COLOR_COUNT);
+}
+
+void PuzzleEngine::solveButton(const Edgework& edgework)
+{
+  const uint8_t batteries = batteryCount(edgework);
+
+  if (button == BUTTON_BLUE && label == BUTTON_ABORT) {
+    hold = true;
+  } else if (batteries > 1 && label == BUTTON_DETONATE) {
+    hold = false;
+  } else if (button == BUTTON_WHITE && hasLitLabel(edgework, LABEL_CAR)) {
+    hold = true;
+  } else if (batteries > 2 && hasLitLabel(edgework, LABEL_FRK)) {
+    hold = false;
+  } else if (button == BUTTON_YELLOW) {
+    hold = true;
+  } else if (button == BUTTON_RED && label == BUTTON_HOLD) {
+    hold = false;
+  } else {
+    hold = true;
+  }
+
+  switch (strip) {
+    case BUTTON_BLUE:
+      releaseDigit = 4;
+      break;
+    case BUTTON_YELLOW:
+      releaseDigit = 5;
+      break;
+    default:
+      releaseDigit = 1;
+      break;
+  }
+}
+
+uint8_t PuzzleEngine::countWires(uint8_t color) const
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < wires; i++) {
+    if (wireColors[i] == color) {
+      count++;
+    }
+  }
+  return count;
+}
+
+uint8_t PuzzleEngine::lastWire(uint8_t color) const
+{
+  for (uint8_t i = wires; i > 0; i--) {
+    if (wireColors[i - 1] == color) {
+      return i - 1;
+    }
+  }
+  return NO_WIRE;
+}
+
+// Serial numbers may end in a letter, the rule looks at the last digit
+bool PuzzleEngine::serialOdd(const Edgework& edgework)
+{
+  for (uint8_t i = SERIAL_NUMBER_LENGTH; i > 0; i--) {
+    char c = edgework.serial[i - 1];
+    if (c >= '0' && c <= '9') {
+      return (c - '0') % 2 == 1;
+    }
+  }
+  return false;
+}
+
+uint8_t PuzzleEngine::batteryCount(const Edgework& edgework)
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < BATTERY_COUNT; i++) {
+    count += edgework.batteries[i];
+  }
+  return count;
+}
+
+bool PuzzleEngine::hasLitLabel(const Edgework& edgework, uint8_t label)
+{
+  for (uint8_t i = 0; i < edgework.labelCount; i++) {
+    if (edgework.labels[i].label == label && edgework.labels[i].lit) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PuzzleEngine::timeShowsDigit(uint16_t remainingSeconds, uint8_t digit)
+{
+  uint8_t minutes = remainingSeconds / 60;
+  uint8_t seconds = remainingSeconds % 60;
+  return minutes / 10 == digit || minutes % 10 == digit
+    || seconds / 10 == digit || seconds % 10 == digit;
+}
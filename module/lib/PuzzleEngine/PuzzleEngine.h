@@ -0,0 +1,100 @@
+#ifndef PUZZLE_ENGINE_H
+#define PUZZLE_ENGINE_H
+
+#include <stdint.h>
+#include <Edgework.h>
+
+/*
+ * Puzzle rules, evaluated once per game.
+ *
+ * begin() expands the game seed into the puzzle layout (wire colours,
+ * button colour and label, strip colour) and runs the manual's rules against
+ * it and the edgework. What is left is a solution table: the outcome of
+ * cutting each wire, whether the button has to be held, and the digit to
+ * release it on. Checking player input is then a table lookup that answers
+ * strike or solve at once.
+ *
+ * The layout uses its own stream of the edgework generator, salted so it is
+ * independent of the edgework drawn from the same seed.
+ */
+
+#define PUZZLE_SEED_SALT 0x9E3779B9UL
+#define PUZZLE_MIN_WIRES 3
+#define PUZZLE_MAX_WIRES 6
+#define PUZZLE_TAP_MILLIS 500
+
+enum PuzzleOutcome : uint8_t {
+  PUZZLE_NOTHING,
+  PUZZLE_STRIKE,
+  PUZZLE_SOLVED
+};
+
+enum WireColor : uint8_t {
+  WIRE_RED,
+  WIRE_WHITE,
+  WIRE_BLUE,
+  WIRE_YELLOW,
+  WIRE_BLACK,
+  WIRE_COLOR_COUNT
+};
+
+enum ButtonColor : uint8_t {
+  BUTTON_RED,
+  BUTTON_WHITE,
+  BUTTON_BLUE,
+  BUTTON_YELLOW,
+  BUTTON_COLOR_COUNT
+};
+
+enum ButtonLabel : uint8_t {
+  BUTTON_ABORT,
+  BUTTON_DETONATE,
+  BUTTON_HOLD,
+  BUTTON_PRESS,
+  BUTTON_LABEL_COUNT
+};
+
+class PuzzleEngine {
+public:
+  void begin(uint32_t seed, const Edgework& edgework);
+
+  uint8_t wireCount() const { return wires; }
+  uint8_t wireColor(uint8_t wire) const { return wireColors[wire]; }
+  uint8_t wireToCut() const { return cutWire; }
+  PuzzleOutcome cut(uint8_t wire);
+
+  uint8_t buttonColor() const { return button; }
+  uint8_t buttonLabel() const { return label; }
+  uint8_t stripColor() const { return strip; }
+  bool holdRequired() const { return hold; }
+  PuzzleOutcome release(uint32_t heldMillis, uint16_t remainingSeconds);
+
+  bool solved() const { return isSolved; }
+
+private:
+  void layoutWires(uint32_t& state);
+  void solveWires(const Edgework& edgework);
+  void layoutButton(uint32_t& state);
+  void solveButton(const Edgework& edgework);
+
+  uint8_t countWires(uint8_t color) const;
+  uint8_t lastWire(uint8_t color) const;
+  static bool serialOdd(const Edgework& edgework);
+  static uint8_t batteryCount(const Edgework& edgework);
+  static bool hasLitLabel(const Edgework& edgework, uint8_t label);
+  static bool timeShowsDigit(uint16_t remainingSeconds, uint8_t digit);
+
+  uint8_t wires = 0;
+  uint8_t wireColors[PUZZLE_MAX_WIRES];
+  uint8_t wireOutcomes[PUZZLE_MAX_WIRES];
+  uint8_t cutWire = 0;
+  bool isSolved = false;
+
+  uint8_t button = 0;
+  uint8_t label = 0;
+  uint8_t strip = 0;
+  bool hold = false;
+  uint8_t releaseDigit = 0;
+};
+
+#endif
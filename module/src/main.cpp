@@ -1,30 +1,40 @@
 #include <Arduino.h>
 #include <Wire.h>
-#include <ArduinoJson.h>
-
-#define I2C_ADDRESS 0x49  // Module's unique I2C address
-String MODULE_TYPE = "TEST";
+#include <util/atomic.h>
+#include <avr/wdt.h>
+#include <avr/sleep.h>
+#include <avr/power.h>
+#include <Protocol.h>
+#include <ClockSync.h>
+#include <TokenLog.h>
+#include <BombConstants.h>
+#include <Edgework.h>
+#include <PuzzleEngine.h>
+#include <MemDiag.h>
+
+const uint8_t MODULE_TYPE = MODULE_TYPE_TEST;
 bool IS_NEEDY = true;
+const uint16_t MAX_BUS_KHZ = PROTOCOL_BUS_FAST_KHZ;
 
 /* METHOD DEFINITIONS */
-void provisionModule(JsonObject input);
 void receiveMessage(int howMany);
 void answerRequest();
-void prepareIdent();
 void sendReady();
 void sendMistake();
 void sendSolved();
 void clockTick();
-
-struct Label {
-  String label;
-  bool lit;
-};
+void checkNeedy();
+void startGame(uint32_t seed);
+void checkPuzzle();
+uint16_t remainingSeconds();
+void processMessage();
+void powerBegin();
+void idle();
+void noteBusEvent();
+template <typename Message> void queueMessage(const Message& message, bool raiseRequest);
 
 const int REQUEST_PIN = 4;
 const int CLOCK_PIN = 2;
-volatile int chunkIndex = 0;
-int lastChunk = 0;
 
 /*
  * 1 = boot
@@ -37,42 +47,96 @@ int globalState = 1;
 // Variables will change:
 const int buttonPin = 8;
 int btnState = LOW;
-String receivedCommand = "";
 
-String waitingCommand = "";
+/* BUS */
+// Frame waiting for the master's next read, written by loop() and the Wire ISR
+uint8_t txFrame[PROTOCOL_MAX_UPLINK_FRAME];
+volatile uint8_t txLength = 0;
+// Frame from the master, copied in by the Wire ISR and handled by loop()
+uint8_t rxFrame[PROTOCOL_MAX_DOWNLINK_FRAME];
+volatile uint8_t rxLength = 0;
+volatile bool rxPending = false;
+volatile bool rxSelected = false;
+volatile uint8_t rxDropped = 0;
+volatile uint8_t rxOverlong = 0;
 bool readyPrepared = false;
+uint8_t busAddress = PROTOCOL_DEFAULT_ADDRESS;
+bool requestPinDriven = false;
 
 /* BASE SETTINGS */
-String serialNumber;
 int baseLives;
 int baseTime;
-int batteryCountAA;
-int batteryCountD;
-int portCountVGA;
-int portCountRJ45;
-int portCountRCA;
-int portCountPS2;
-Label bombLabels[4] = {};
-int labelCount = 0;
+Edgework edgework = {};
+
+/* PUZZLE */
+PuzzleEngine puzzle;
+// The button must read the same this long before a press or release counts
+const unsigned long PUZZLE_DEBOUNCE_MILLIS = 20;
+bool puzzleButtonDown = false;
+bool puzzleButtonReading = false;
+unsigned long puzzleButtonChanged = 0;
+unsigned long puzzleButtonPressed = 0;
 
 /* GAME VARS */
-volatile int currentTime = -1;
 int currentLives = -1;
 
+/* GAME TIME */
+// Whole seconds come from the master's clock tick, only the parts before the
+// first and after the last tick since the sync are timed with millis()
+uint32_t syncedRemaining = 0;
+unsigned long syncedAt = 0;
+uint8_t syncedRate = CLOCK_SYNC_RATE_BASE;
+volatile uint16_t ticksSinceSync = 0;
+volatile unsigned long firstTickAt = 0;
+volatile unsigned long lastTickAt = 0;
+
+/* POWER */
+// Wake to the first bus callback, covers the bus transfer of the longest frame at 100 kHz
+const unsigned long WAKE_LATENCY_BUDGET = 5000;
+// Wakes over budget in a row before standby is given up, a single one is noise
+const uint8_t WAKE_OVER_BUDGET_LIMIT = 3;
+// Standby stops the TWI clock, so the module stays in idle mode while the master may still be talking
+const unsigned long STANDBY_HOLD = 10;
+const uint8_t WAKE_NONE = 0;
+const uint8_t WAKE_ASLEEP = 1;    // in standby, a bus callback now runs in the waking interrupt
+const uint8_t WAKE_AWAITED = 2;   // awake since wokeAt, no bus callback yet
+const uint8_t WAKE_MEASURED = 3;  // wakeLatency is waiting for loop()
+bool standbyAllowed = true;
+volatile uint8_t wakeState = WAKE_NONE;
+volatile unsigned long wokeAt = 0;
+volatile unsigned long wakeLatency = 0;
+unsigned long standbyLeft = 0;
+unsigned long worstWakeLatency = 0;
+uint8_t wakesOverBudget = 0;
+
+/* NEEDY */
+volatile bool needyActive = false;
+volatile unsigned long needyDeadline = 0;
+
 void setup() {
-  Serial.begin(9600);
-  pinMode(REQUEST_PIN, OUTPUT);
-  digitalWrite(REQUEST_PIN, LOW);
-  delay(1000);
-  Wire.begin(I2C_ADDRESS);  // Join I2C bus as slave
+  logBegin();
+  LOG_INFO(BOOT);
+  memDiagBegin();
+  // The master drives the request line while it assigns addresses
+  pinMode(REQUEST_PIN, INPUT);
+  Wire.begin(PROTOCOL_DEFAULT_ADDRESS);  // Join I2C bus as slave
   Wire.onReceive(receiveMessage);  // Register callback for when master requests data
   Wire.onRequest(answerRequest);  // Register callback for when master requests data
 
-  //pinMode(buttonPin, INPUT);
+  pinMode(buttonPin, INPUT);
+  powerBegin();
   globalState = 2;
+
+  // a hung module resets and is re-provisioned by the master
+  wdt_enable(WDTO_250MS);
 }
 
 void loop() {
+  wdt_reset();
+  logFlush();
+  memDiagSample(globalState);
+  processMessage();
+
   switch (globalState) {
     case 1:
 
@@ -81,8 +145,6 @@ void loop() {
       
     break;
     case 3:
-      // setup game
-      delay(5000);
       sendReady();
 
       // enable clock Tick
@@ -90,10 +152,14 @@ void loop() {
       attachInterrupt(digitalPinToInterrupt(CLOCK_PIN), clockTick, RISING);
     break;
     case 4:
-      delay(10000);
-      sendMistake();
+      if (IS_NEEDY) {
+        checkNeedy();
+      } else {
+        checkPuzzle();
+      }
     break;
   }
+  idle();
   /*btnState = digitalRead(buttonPin);
   if(btnState == HIGH)
   {
@@ -106,153 +172,429 @@ void loop() {
   }*/
 }
 
+/*
+ * Every master command arrives as one frame in a single transmission. This
+ * runs in the TWI interrupt, so it only copies the frame for loop(); a frame
+ * that arrives before loop() has taken the previous one is dropped. So is a
+ * transmission longer than any downlink frame, see protocolReceiveDownlink().
+ * An address offer
+ * samples the request line here, while the master is certain to drive it.
+ */
 void receiveMessage(int howMany) {
-  String input = "";
-  while (Wire.available()) { // peripheral may send less than requested
-    input += (char) Wire.read(); // receive a byte as character
-  }
-  if (input == "\0") {
-    Serial.println(receivedCommand);
-    JsonDocument doc; 
-    deserializeJson(doc, receivedCommand);
-
-    const String action = doc["action"];
-
-    if (action == "ping") {
-      Wire.write("{\"ack\":true}");
-    } else if (action == "erp") {
-      digitalWrite(REQUEST_PIN, HIGH);
-      Wire.write("{\"ack\":true}");
-    } else if (action == "drp") {
-      digitalWrite(REQUEST_PIN, LOW);
-      Wire.write("{\"ack\":true}");
-    } else if (action == "ident") {
-      prepareIdent();
-    } else if (action == "provision") {
-      provisionModule(doc["data"].as<JsonObject>());
+  noteBusEvent();
+  if (howMany == 0) {
+    return;
+  }
+  if (rxPending) {
+    rxDropped++;
+    return;
+  }
+
+  uint8_t length = protocolReceiveDownlink(Wire, rxFrame);
+  if (length == 0) {
+    rxOverlong = howMany;
+    return;
+  }
+  if (rxFrame[0] == PROTOCOL_OP_AssignAddress) {
+    rxSelected = digitalRead(REQUEST_PIN) == HIGH;
+  }
+  rxLength = length;
+  rxPending = true;
+}
+
+/*
+ * Hands the received frame to the matching on<Name>() below. The ISR does
+ * not touch rxFrame until rxPending is cleared.
+ */
+void processMessage() {
+  if (rxPending && !requestPinDriven && busAddress != PROTOCOL_DEFAULT_ADDRESS) {
+    // first frame on the new address, the master has let go of the line
+    digitalWrite(REQUEST_PIN, LOW);
+    pinMode(REQUEST_PIN, OUTPUT);
+    requestPinDriven = true;
+  }
+  if (rxDropped > 0) {
+    uint8_t dropped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      dropped = rxDropped;
+      rxDropped = 0;
+    }
+    LOG_WARN(COMMAND_DROPPED, dropped);
+  }
+  if (rxOverlong > 0) {
+    LOG_WARN(COMMAND_OVERLONG, rxOverlong);
+    rxOverlong = 0;
+  }
+  if (!rxPending) {
+    return;
+  }
+
+  LOG_DEBUG(COMMAND_RECEIVED, rxLength);
+  protocolDispatchDownlink(0, rxFrame, rxLength);
+  rxPending = false;
+
+  if (wakeState == WAKE_MEASURED) {
+    unsigned long latency = wakeLatency;
+    wakeState = WAKE_NONE;
+    if (latency <= WAKE_LATENCY_BUDGET) {
+      wakesOverBudget = 0;
+      if (latency > worstWakeLatency) {
+        worstWakeLatency = latency;
+        LOG_INFO(WAKE_LATENCY, latency);
+      }
+    } else if (++wakesOverBudget < WAKE_OVER_BUDGET_LIMIT) {
+      LOG_WARN(WAKE_OVER_BUDGET, latency, wakesOverBudget);
+    } else {
+      standbyAllowed = false;
+      LOG_WARN(STANDBY_DISABLED, wakesOverBudget);
+    }
+  }
+}
+
+/*
+ * Called first by both Wire callbacks. The first one after a standby wake
+ * takes the wake latency, here in the interrupt rather than when loop()
+ * gets to the command. A callback in the interrupt that woke the module
+ * counts as no latency at all.
+ */
+void noteBusEvent() {
+  if (wakeState == WAKE_ASLEEP) {
+    wakeLatency = 0;
+    wakeState = WAKE_MEASURED;
+  } else if (wakeState == WAKE_AWAITED) {
+    wakeLatency = micros() - wokeAt;
+    wakeState = WAKE_MEASURED;
+  }
+}
+
+/*
+ * Gates what the module never uses: ADC, analog comparator, SPI, Timer1
+ * and Timer2. TWI, USART0 for the log and Timer0 for millis() stay on. The
+ * button gets a pin change interrupt, it has no handler and only wakes the
+ * module.
+ */
+void powerBegin() {
+  ADCSRA = 0;
+  ACSR = _BV(ACD);
+  power_adc_disable();
+  power_spi_disable();
+  power_timer1_disable();
+  power_timer2_disable();
+
+  *digitalPinToPCMSK(buttonPin) |= _BV(digitalPinToPCMSKbit(buttonPin));
+  *digitalPinToPCICR(buttonPin) |= _BV(digitalPinToPCICRbit(buttonPin));
+}
+
+EMPTY_INTERRUPT(PCINT0_vect);  // buttonPin 8 is PB0
+
+/*
+ * Sleeps until the next interrupt once loop() is done. While waiting for
+ * provisioning the module uses standby: CPU and I/O clocks stop, only a
+ * TWI address match or the button wake it, and since the oscillator keeps
+ * running that takes 6 cycles instead of the 1 ms start-up of power-down,
+ * well inside the master's bus timeout. For STANDBY_HOLD after a wake, and
+ * during a game, it uses idle mode, where the clock tick on INT0, Timer0
+ * and the bus keep running. millis() does not advance in standby.
+ */
+void idle() {
+  bool holding = millis() - standbyLeft < STANDBY_HOLD;
+  if (!holding && wakeState == WAKE_AWAITED) {
+    wakeState = WAKE_NONE;  // woken by the button, not the bus
+  }
+  bool standby = globalState == 2 && standbyAllowed && !holding;
+  if (standby) {
+    if (!logIdle()) {
+      return;
     }
-    receivedCommand = "";
-  } else {
-    receivedCommand += input;
+#if LOG_LEVEL > LOG_LEVEL_NONE
+    Serial.flush();
+#endif
+  }
+
+  set_sleep_mode(standby ? SLEEP_MODE_STANDBY : SLEEP_MODE_IDLE);
+  cli();
+  if (rxPending) {
+    sei();
+    return;
+  }
+  if (standby) {
+    // nothing runs in standby that could hang, and the watchdog would end it
+    wdt_disable();
+  }
+  sleep_enable();
+  if (standby) {
+    wakeState = WAKE_ASLEEP;
+    sleep_bod_disable();
+  }
+  sei();
+  sleep_cpu();
+  sleep_disable();
+
+  if (standby) {
+    wdt_enable(WDTO_250MS);
+    standbyLeft = millis();
+    cli();
+    if (wakeState == WAKE_ASLEEP) {
+      wokeAt = micros();
+      wakeState = WAKE_AWAITED;
+    }
+    sei();
   }
 }
 
 void answerRequest() {
-  // Ensure waitingCommand has content
-  if (waitingCommand.length() == 0) {
-    Wire.write(""); // Send an empty response if no message is prepared
+  noteBusEvent();
+  if (txLength == 0) {
+    Wire.write((uint8_t) PROTOCOL_OP_NONE);
     return;
   }
 
-  // Convert String to char array
-  static char message[128]; // Adjust size as needed for the longest expected message
-  waitingCommand.toCharArray(message, waitingCommand.length() + 1); // +1 for null terminator
+  Wire.write(txFrame, txLength);
+  txLength = 0;
+  digitalWrite(REQUEST_PIN, LOW);
+  LOG_DEBUG(REPLY_SENT);
+}
+
+template <typename Message>
+void queueMessage(const Message& message, bool raiseRequest) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    txLength = protocolEncode(message, txFrame);
+  }
+  if (raiseRequest) {
+    digitalWrite(REQUEST_PIN, HIGH);
+  }
+}
 
-  // Calculate the number of chunks
-  int totalChunks = (waitingCommand.length() + 5) / 6; // Round up to include partial chunks
+void onPing(uint8_t source, const PingMessage& message) {
+}
 
-  // Send the current chunk
-  Wire.write(message + (chunkIndex * 6), min(6, waitingCommand.length() - (chunkIndex * 6)));
+void onEnableRequestPin(uint8_t source, const EnableRequestPinMessage& message) {
+  digitalWrite(REQUEST_PIN, HIGH);
+}
 
-  // Update chunk index
-  chunkIndex = (chunkIndex + 1) % totalChunks;
+void onDisableRequestPin(uint8_t source, const DisableRequestPinMessage& message) {
+  digitalWrite(REQUEST_PIN, LOW);
+}
 
-  // Reset the request pin only after the last chunk
-  if (chunkIndex == 0) {
-    Wire.write("\0");
-    digitalWrite(REQUEST_PIN, LOW);
-    waitingCommand = ""; // Clear the message after the last chunk
-    Serial.println("sent command");
+/*
+ * All modules share the default address, so only the one whose request line
+ * the master held HIGH during the offer takes the new address.
+ */
+void onAssignAddress(uint8_t source, const AssignAddressMessage& message) {
+  if (busAddress != PROTOCOL_DEFAULT_ADDRESS || !rxSelected) {
+    return;
   }
+  busAddress = message.address;
+  Wire.begin(busAddress);
+  LOG_INFO(ADDRESS_ASSIGNED, busAddress);
 }
 
-void provisionModule(JsonObject input) {
-  serialNumber = input["serial"].as<String>();
-  baseLives = input["lives"];
-  baseTime = input["time"];
-  randomSeed(input["seed"]);
-  batteryCountAA = input["batteries"]["AA"];
-  batteryCountD = input["batteries"]["D"];
-  portCountVGA = input["ports"]["VGA"];
-  portCountRJ45 = input["ports"]["RJ45"];
-  portCountRCA = input["ports"]["RCA"];
-  portCountPS2 = input["ports"]["PS2"];
-  
-  // todo: ports
-  if (input.containsKey("labels")) {
-    JsonArray labels = input["labels"].as<JsonArray>();
-    for (size_t i = 0; i < labels.size(); i++) {
-      JsonObject labelObj = labels[i].as<JsonObject>();
-      bombLabels[i].label = labelObj["label"].as<String>();
-      bombLabels[i].lit = labelObj["lit"];
-      labelCount++;
+/*
+ * A master that reset lost its roster and asks modules still on an assigned
+ * address to go back to the default one. Anything queued for the old master
+ * is dropped, the module enrolls again like after boot.
+ */
+void onReleaseAddress(uint8_t source, const ReleaseAddressMessage& message) {
+  if (busAddress == PROTOCOL_DEFAULT_ADDRESS) {
+    return;
+  }
+  LOG_INFO(ADDRESS_RELEASED, busAddress);
+  pinMode(REQUEST_PIN, INPUT);
+  requestPinDriven = false;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    txLength = 0;
+  }
+  readyPrepared = false;
+  busAddress = PROTOCOL_DEFAULT_ADDRESS;
+  Wire.begin(busAddress);
+}
+
+void onIdent(uint8_t source, const IdentMessage& message) {
+  IdentReplyMessage reply;
+  reply.type = MODULE_TYPE;
+  reply.needy = IS_NEEDY;
+  reply.maxBusKHz = MAX_BUS_KHZ;
+  reply.maxFrame = sizeof(rxFrame);
+  queueMessage(reply, false);
+}
+
+void onProvision(uint8_t source, const ProvisionMessage& message) {
+  memcpy(edgework.serial, message.serial, SERIAL_NUMBER_LENGTH);
+  edgework.serial[SERIAL_NUMBER_LENGTH] = '\0';
+  baseLives = message.lives;
+  baseTime = message.time;
+  memcpy(edgework.ports, message.ports, PORT_COUNT);
+  memcpy(edgework.batteries, message.batteries, BATTERY_COUNT);
+
+  edgework.labelCount = 0;
+  for (uint8_t i = 0; i < PROTOCOL_MAX_LABELS; i++) {
+    if (message.labels[i] != PROTOCOL_LABEL_NONE) {
+      edgework.labels[edgework.labelCount++] = protocolUnpackLabel(message.labels[i]);
     }
   }
 
-  currentLives = baseLives;
-  currentTime = baseTime + 1;
+  LOG_INFO(PROVISIONED);
+  startGame(message.seed);
+}
 
-  Serial.println("Module provisioned");
+/*
+ * Same game setup as onProvision(), but the edgework is derived from the seed
+ * the way the master generated it, and settings are only taken if changed.
+ */
+void onRematch(uint8_t source, const RematchMessage& message) {
+  if (message.changed & PROTOCOL_REMATCH_LIVES) {
+    baseLives = message.lives;
+  }
+  if (message.changed & PROTOCOL_REMATCH_TIME) {
+    baseTime = message.time;
+  }
+  edgeworkGenerate(message.seed, edgework);
+
+  LOG_INFO(PROVISIONED);
+  startGame(message.seed);
+}
+
+/*
+ * Everything the puzzle needs is precomputed here, so input handling in
+ * checkPuzzle() is a lookup.
+ */
+void startGame(uint32_t seed) {
+  randomSeed(seed);
+  unsigned long start = micros();
+  puzzle.begin(seed, edgework);
+  LOG_INFO(PUZZLE_READY, micros() - start);
+  LOG_DEBUG(PUZZLE_BUTTON, puzzle.buttonColor(), puzzle.buttonLabel(), puzzle.stripColor());
+  puzzleButtonDown = false;
+  puzzleButtonReading = false;
 
+  currentLives = baseLives;
+  syncedRemaining = baseTime * 1000UL;
+  syncedAt = millis();
+  syncedRate = CLOCK_SYNC_RATE_BASE;
+  ticksSinceSync = 0;
+  needyActive = false;
+  readyPrepared = false;
   globalState = 3;
 }
 
-void prepareIdent() {
-  JsonDocument identDocument;
-  identDocument["action"] = "ident";
-  identDocument["isNeedy"] = IS_NEEDY;
-  identDocument["type"] = MODULE_TYPE;
-  
-  String identCommand;
-  serializeJson(identDocument, identCommand);
+void onNeedyActivate(uint8_t source, const NeedyActivateMessage& message) {
+  needyDeadline = millis() + message.seconds * 1000UL;
+  needyActive = true;
+}
 
-  waitingCommand = identCommand;
+void onNeedyDeactivate(uint8_t source, const NeedyDeactivateMessage& message) {
+  needyActive = false;
 }
 
 void sendReady()
 {
   if (!readyPrepared) {
-    JsonDocument readyDocument;
-    readyDocument["action"] = "ready";
-    
-    String readyCommand;
-    serializeJson(readyDocument, readyCommand);
-
-    waitingCommand = readyCommand;
-    digitalWrite(REQUEST_PIN, HIGH);
+    queueMessage(ReadyMessage(), true);
     readyPrepared = true;
 
-    Serial.println("Ready prepared");
+    LOG_DEBUG(READY_PREPARED);
   }
 }
 
 void sendMistake()
 {
-  JsonDocument mistakeDocument;
-  mistakeDocument["action"] = "mistake";
-  
-  String mistakeCommand;
-  serializeJson(mistakeDocument, mistakeCommand);
-
-  waitingCommand = mistakeCommand;
-  digitalWrite(REQUEST_PIN, HIGH);
-  Serial.println("started request");
+  queueMessage(MistakeMessage(), true);
+  LOG_DEBUG(REQUEST_STARTED);
 }
 
 void sendSolved()
 {
-  JsonDocument solvedDocument;
-  solvedDocument["action"] = "solved";
-  
-  String solvedCommand;
-  serializeJson(solvedDocument, solvedCommand);
-
-  waitingCommand = solvedCommand;
-  digitalWrite(REQUEST_PIN, HIGH);
+  queueMessage(SolvedMessage(), true);
 }
 
 void clockTick()
 {
   globalState = 4;
-  currentTime--;
-}
\ No newline at end of file
+  unsigned long now = millis();
+  if (ticksSinceSync++ == 0) {
+    firstTickAt = now;
+  }
+  lastTickAt = now;
+}
+
+// Sent when the game starts and on every strike, which speeds the clock up
+void onTimeSync(uint8_t source, const TimeSyncMessage& message) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    syncedRemaining = message.remainingMillis;
+    syncedAt = millis();
+    syncedRate = clockSyncRate(message.strikes);
+    ticksSinceSync = 0;
+  }
+}
+
+// The seconds the clock shows
+uint16_t remainingSeconds()
+{
+  uint16_t ticks;
+  unsigned long first;
+  unsigned long last;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ticks = ticksSinceSync;
+    first = firstTickAt;
+    last = lastTickAt;
+  }
+  unsigned long now = millis();
+  unsigned long elapsed = ticks == 0 ? now - syncedAt
+                                     : (first - syncedAt) + (ticks - 1) * 1000UL + (now - last);
+  uint32_t consumed = elapsed * syncedRate / CLOCK_SYNC_RATE_BASE;
+  return consumed >= syncedRemaining ? 0 : (syncedRemaining - consumed) / 1000;
+}
+
+/*
+ * The master owns the needy deadline and issues the strike when it passes,
+ * the module only reports when the player has dealt with it.
+ */
+void checkNeedy()
+{
+  if (!needyActive) {
+    return;
+  }
+  if ((long) (millis() - needyDeadline) >= 0) {
+    needyActive = false;
+    return;
+  }
+  if (digitalRead(buttonPin) == HIGH) {
+    needyActive = false;
+    sendSolved();
+  }
+}
+
+/*
+ * The test module's button plays The Button: tap or hold, then release on
+ * the right digit. The engine decides strike or solve on a release that has
+ * been stable for PUZZLE_DEBOUNCE_MILLIS, like the master's encoder button.
+ */
+void checkPuzzle()
+{
+  if (puzzle.solved()) {
+    return;
+  }
+
+  bool reading = digitalRead(buttonPin) == HIGH;
+  unsigned long now = millis();
+  if (reading != puzzleButtonReading) {
+    puzzleButtonReading = reading;
+    puzzleButtonChanged = now;
+  }
+  if (reading == puzzleButtonDown || now - puzzleButtonChanged < PUZZLE_DEBOUNCE_MILLIS) {
+    return;
+  }
+
+  // the hold is measured between the last bounces of both edges
+  puzzleButtonDown = reading;
+  if (puzzleButtonDown) {
+    puzzleButtonPressed = puzzleButtonChanged;
+    return;
+  }
+  PuzzleOutcome outcome = puzzle.release(puzzleButtonChanged - puzzleButtonPressed, remainingSeconds());
+  if (outcome == PUZZLE_SOLVED) {
+    sendSolved();
+  } else if (outcome == PUZZLE_STRIKE) {
+    sendMistake();
+  }
+}
@@ -0,0 +1,88 @@
+#include "BombConstants.h"
+
+#ifndef ARDUINO
+// Host builds, e.g. the puzzle check linking Edgework
+#define PROGMEM
+#define pgm_read_ptr(address) (*(address))
+#define pgm_read_byte(address) (*(address))
+#endif
+
+#define FLASH_STRING_TABLE_ENTRY(table, index) \
+  reinterpret_cast<const __FlashStringHelper*>(pgm_read_ptr(&table[index]))
+
+static const char LABEL_SND_NAME[] PROGMEM = "SND";
+static const char LABEL_CLR_NAME[] PROGMEM = "CLR";
+static const char LABEL_CAR_NAME[] PROGMEM = "CAR";
+static const char LABEL_IND_NAME[] PROGMEM = "IND";
+static const char LABEL_FRQ_NAME[] PROGMEM = "FRQ";
+static const char LABEL_SIG_NAME[] PROGMEM = "SIG";
+static const char LABEL_NSA_NAME[] PROGMEM = "NSA";
+static const char LABEL_MSA_NAME[] PROGMEM = "MSA";
+static const char LABEL_TRN_NAME[] PROGMEM = "TRN";
+static const char LABEL_BOB_NAME[] PROGMEM = "BOB";
+static const char LABEL_FRK_NAME[] PROGMEM = "FRK";
+
+static const char* const LABEL_NAMES[LABEL_COUNT] PROGMEM = {
+  LABEL_SND_NAME, LABEL_CLR_NAME, LABEL_CAR_NAME, LABEL_IND_NAME,
+  LABEL_FRQ_NAME, LABEL_SIG_NAME, LABEL_NSA_NAME, LABEL_MSA_NAME,
+  LABEL_TRN_NAME, LABEL_BOB_NAME, LABEL_FRK_NAME
+};
+
+static const char PORT_VGA_NAME[] PROGMEM = "VGA";
+static const char PORT_PS2_NAME[] PROGMEM = "PS2";
+static const char PORT_RJ45_NAME[] PROGMEM = "RJ45";
+static const char PORT_RCA_NAME[] PROGMEM = "RCA";
+
+static const char* const PORT_NAMES[PORT_COUNT] PROGMEM = {
+  PORT_VGA_NAME, PORT_PS2_NAME, PORT_RJ45_NAME, PORT_RCA_NAME
+};
+
+static const char BATTERY_AA_NAME[] PROGMEM = "AA";
+static const char BATTERY_D_NAME[] PROGMEM = "D";
+
+static const char* const BATTERY_NAMES[BATTERY_COUNT] PROGMEM = {
+  BATTERY_AA_NAME, BATTERY_D_NAME
+};
+
+static const char MODULE_TYPE_NONE_NAME[] PROGMEM = "";
+static const char MODULE_TYPE_TEST_NAME[] PROGMEM = "TEST";
+
+static const char* const MODULE_TYPE_NAMES[MODULE_TYPE_COUNT] PROGMEM = {
+  MODULE_TYPE_NONE_NAME, MODULE_TYPE_TEST_NAME
+};
+
+// Most letters appear twice, so they are drawn more often than digits
+static const char SERIAL_ALPHABET[] PROGMEM =
+  "ABCDEFGHJKLMNPQRSTUVWXYZ"
+  "ABCDFGHJKLMNPQRSTVWXYZ"
+  "123456789";
+
+const __FlashStringHelper* labelName(uint8_t label)
+{
+  return FLASH_STRING_TABLE_ENTRY(LABEL_NAMES, label < LABEL_COUNT ? label : 0);
+}
+
+const __FlashStringHelper* portName(uint8_t port)
+{
+  return FLASH_STRING_TABLE_ENTRY(PORT_NAMES, port < PORT_COUNT ? port : 0);
+}
+
+const __FlashStringHelper* batteryName(uint8_t battery)
+{
+  return FLASH_STRING_TABLE_ENTRY(BATTERY_NAMES, battery < BATTERY_COUNT ? battery : 0);
+}
+
+const __FlashStringHelper* moduleTypeName(uint8_t type)
+{
+  return FLASH_STRING_TABLE_ENTRY(MODULE_TYPE_NAMES, type < MODULE_TYPE_COUNT ? type : (uint8_t) MODULE_TYPE_NONE);
+}
+
+uint8_t serialAlphabetLength()
+{
+  return sizeof(SERIAL_ALPHABET) - 1;
+}
+
+char serialAlphabetCharacter(uint8_t index)
+{
+  return pgm_read_byte(&SERIAL_ALPHABET[index]);
+}
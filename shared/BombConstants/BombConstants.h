@@ -0,0 +1,67 @@
+#ifndef BOMB_CONSTANTS_H
+#define BOMB_CONSTANTS_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stdint.h>
+class __FlashStringHelper;
+#endif
+
+/*
+ * Edgework and module identifiers shared by master and modules. Only the
+ * numeric ids travel over the bus and live in RAM; the names are kept in
+ * flash and only looked up for display.
+ */
+
+enum LabelId : uint8_t {
+  LABEL_SND,
+  LABEL_CLR,
+  LABEL_CAR,
+  LABEL_IND,
+  LABEL_FRQ,
+  LABEL_SIG,
+  LABEL_NSA,
+  LABEL_MSA,
+  LABEL_TRN,
+  LABEL_BOB,
+  LABEL_FRK,
+  LABEL_COUNT
+};
+
+enum PortId : uint8_t {
+  PORT_VGA,
+  PORT_PS2,
+  PORT_RJ45,
+  PORT_RCA,
+  PORT_COUNT
+};
+
+enum BatteryId : uint8_t {
+  BATTERY_AA,
+  BATTERY_D,
+  BATTERY_COUNT
+};
+
+enum ModuleType : uint8_t {
+  MODULE_TYPE_NONE,
+  MODULE_TYPE_TEST,
+  MODULE_TYPE_COUNT
+};
+
+#define SERIAL_NUMBER_LENGTH 8
+
+struct Label {
+  uint8_t label;
+  bool lit;
+};
+
+const __FlashStringHelper* labelName(uint8_t label);
+const __FlashStringHelper* portName(uint8_t port);
+const __FlashStringHelper* batteryName(uint8_t battery);
+const __FlashStringHelper* moduleTypeName(uint8_t type);
+
+uint8_t serialAlphabetLength();
+char serialAlphabetCharacter(uint8_t index);
+
+#endif
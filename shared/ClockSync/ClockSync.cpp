@@ -0,0 +1,59 @@
+#include "ClockSync.h"
+
+uint8_t clockSyncRate(uint8_t strikes)
+{
+  if (strikes > CLOCK_SYNC_MAX_STRIKES) {
+    strikes = CLOCK_SYNC_MAX_STRIKES;
+  }
+  return CLOCK_SYNC_RATE_BASE + strikes;
+}
+
+static uint8_t clockSyncChecksum(const uint8_t* frame)
+{
+  uint8_t checksum = 0;
+  for (uint8_t i = 1; i < CLOCK_SYNC_FRAME_SIZE - 1; i++) {
+    checksum ^= frame[i];
+  }
+  return checksum;
+}
+
+uint8_t clockSyncEncode(const ClockSync& sync, uint8_t* frame)
+{
+  frame[0] = CLOCK_SYNC_START;
+  frame[1] = sync.flags;
+  frame[2] = sync.strikes;
+  frame[3] = sync.remainingMillis;
+  frame[4] = sync.remainingMillis >> 8;
+  frame[5] = sync.remainingMillis >> 16;
+  frame[6] = sync.remainingMillis >> 24;
+  frame[7] = clockSyncChecksum(frame);
+  return CLOCK_SYNC_FRAME_SIZE;
+}
+
+/*
+ * Feeds one received byte. Returns true when a complete frame with a valid
+ * checksum has been received; sync() then holds the decoded values.
+ */
+bool ClockSyncParser::feed(uint8_t value)
+{
+  if (position == 0 && value != CLOCK_SYNC_START) {
+    return false;
+  }
+  frame[position++] = value;
+  if (position < CLOCK_SYNC_FRAME_SIZE) {
+    return false;
+  }
+  position = 0;
+
+  if (clockSyncChecksum(frame) != frame[CLOCK_SYNC_FRAME_SIZE - 1]) {
+    return false;
+  }
+
+  current.flags = frame[1];
+  current.strikes = frame[2];
+  current.remainingMillis = (uint32_t) frame[3]
+    | ((uint32_t) frame[4] << 8)
+    | ((uint32_t) frame[5] << 16)
+    | ((uint32_t) frame[6] << 24);
+  return true;
+}
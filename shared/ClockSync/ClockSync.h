@@ -0,0 +1,52 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+/*
+ * Sync frames sent from the master to the clock module over a TX-only UART.
+ * The master owns the game time; the clock only interpolates between frames.
+ *
+ * Frame layout (8 bytes):
+ *   0      CLOCK_SYNC_START
+ *   1      flags
+ *   2      strikes
+ *   3..6   remaining milliseconds, little endian
+ *   7      XOR of bytes 1..6
+ */
+
+#define CLOCK_SYNC_BAUD 38400
+#define CLOCK_SYNC_START 0xA5
+#define CLOCK_SYNC_FRAME_SIZE 8
+
+// Time runs at (CLOCK_SYNC_RATE_BASE + strikes) / CLOCK_SYNC_RATE_BASE
+#define CLOCK_SYNC_RATE_BASE 4
+#define CLOCK_SYNC_MAX_STRIKES 4
+
+enum ClockSyncFlags : uint8_t {
+  CLOCK_SYNC_RUNNING = 0x01,
+  CLOCK_SYNC_EXPLODED = 0x02,
+  CLOCK_SYNC_DEFUSED = 0x04
+};
+
+struct ClockSync {
+  uint8_t flags;
+  uint8_t strikes;
+  uint32_t remainingMillis;
+};
+
+uint8_t clockSyncRate(uint8_t strikes);
+uint8_t clockSyncEncode(const ClockSync& sync, uint8_t* frame);
+
+class ClockSyncParser {
+public:
+  bool feed(uint8_t value);
+  const ClockSync& sync() const { return current; }
+
+private:
+  uint8_t frame[CLOCK_SYNC_FRAME_SIZE];
+  uint8_t position = 0;
+  ClockSync current = { 0, 0, 0 };
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "Edgework.h"
+
+uint32_t edgeworkNext(uint32_t& state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// Uniform enough for ranges this small: [0, limit)
+uint8_t edgeworkRandom(uint32_t& state, uint8_t limit)
+{
+  return limit > 0 ? edgeworkNext(state) % limit : 0;
+}
+
+void edgeworkGenerate(uint32_t seed, Edgework& edgework)
+{
+  uint32_t state = seed != 0 ? seed : 1;
+
+  for (uint8_t i = 0; i < SERIAL_NUMBER_LENGTH; i++) {
+    edgework.serial[i] = serialAlphabetCharacter(edgeworkRandom(state, serialAlphabetLength()));
+  }
+  edgework.serial[SERIAL_NUMBER_LENGTH] = '\0';
+
+  // Distinct labels: a partial Fisher-Yates shuffle of all label ids
+  uint8_t pool[LABEL_COUNT];
+  for (uint8_t i = 0; i < LABEL_COUNT; i++) {
+    pool[i] = i;
+  }
+  edgework.labelCount = EDGEWORK_LABELS;
+  for (uint8_t i = 0; i < edgework.labelCount; i++) {
+    uint8_t pick = i + edgeworkRandom(state, LABEL_COUNT - i);
+    uint8_t label = pool[pick];
+    pool[pick] = pool[i];
+    pool[i] = label;
+    edgework.labels[i].label = label;
+    edgework.labels[i].lit = edgeworkRandom(state, 3) == 1;
+  }
+
+  uint8_t aa = edgeworkRandom(state, EDGEWORK_MAX_BATTERIES_AA);
+  uint8_t dLimit = EDGEWORK_MAX_BATTERIES_TOTAL - aa;
+  edgework.batteries[BATTERY_AA] = aa;
+  edgework.batteries[BATTERY_D] = edgeworkRandom(state, dLimit < EDGEWORK_MAX_BATTERIES_D ? dLimit : EDGEWORK_MAX_BATTERIES_D);
+
+  uint8_t portsLeft = EDGEWORK_MAX_PORTS_TOTAL;
+  for (uint8_t port = 0; port < PORT_COUNT; port++) {
+    uint8_t count = edgeworkRandom(state, portsLeft < EDGEWORK_MAX_PORTS_PER_TYPE ? portsLeft : EDGEWORK_MAX_PORTS_PER_TYPE);
+    edgework.ports[port] = count;
+    portsLeft -= count;
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef EDGEWORK_H
+#define EDGEWORK_H
+
+#include <stdint.h>
+#include <BombConstants.h>
+
+/*
+ * Serial number, indicator labels, ports and batteries of one game, derived
+ * from the game seed alone. The master and every module run the same
+ * generator, so a rematch only has to send a new seed.
+ *
+ * The generator is a private xorshift32 stream rather than random(), so it
+ * yields the same edgework on every board regardless of what else has
+ * consumed random numbers.
+ */
+
+#define EDGEWORK_LABELS 4
+#define EDGEWORK_MAX_PORTS_TOTAL 5
+#define EDGEWORK_MAX_PORTS_PER_TYPE 2
+#define EDGEWORK_MAX_BATTERIES_TOTAL 6
+#define EDGEWORK_MAX_BATTERIES_AA 6
+#define EDGEWORK_MAX_BATTERIES_D 2
+
+struct Edgework {
+  char serial[SERIAL_NUMBER_LENGTH + 1];
+  Label labels[EDGEWORK_LABELS];
+  uint8_t labelCount;
+  uint8_t ports[PORT_COUNT];
+  uint8_t batteries[BATTERY_COUNT];
+};
+
+void edgeworkGenerate(uint32_t seed, Edgework& edgework);
+
+// The generator itself, for other seed derived state such as puzzles
+uint32_t edgeworkNext(uint32_t& state);
+uint8_t edgeworkRandom(uint32_t& state, uint8_t limit);
+
+#endif
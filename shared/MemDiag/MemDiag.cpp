@@ -0,0 +1,207 @@
+#include "MemDiag.h"
+#include <TokenLog.h>
+#include <util/atomic.h>
+#include <avr/wdt.h>
+
+#define MEMDIAG_MAGIC 0x4D44
+#define MEMDIAG_UNTOUCHED 0xFFFF
+
+struct MemDiagState {
+  uint16_t magic;
+  uint8_t lastPhase;
+  MemDiagPhase phases[MEMDIAG_PHASES];
+};
+
+struct __freelist {
+  size_t sz;
+  struct __freelist* nx;
+};
+
+extern uint8_t _end;
+extern uint8_t __stack;
+extern char* __brkval;
+extern char* __malloc_heap_start;
+extern struct __freelist* __flp;
+
+#ifdef MEMDIAG_PERSIST
+static MemDiagState memDiag __attribute__((section(".noinit")));
+#else
+static MemDiagState memDiag;
+#endif
+
+static uint8_t resetFlags __attribute__((section(".noinit")));
+static uint8_t currentPhase = 0;
+static unsigned long lastSample = 0;
+
+#ifdef __AVR__
+/*
+ * Runs before the C runtime is set up, so it may not use the stack or
+ * assume r1 is zero.
+ */
+void memDiagPaintStack() __attribute__((naked, used, section(".init1")));
+void memDiagPaintStack()
+{
+  __asm volatile (
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, %0\n"
+    "    ldi r25, hi8(__stack)\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(__stack)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n"
+    :: "M" (MEMDIAG_PAINT));
+}
+
+void memDiagCaptureResetFlags() __attribute__((naked, used, section(".init3")));
+void memDiagCaptureResetFlags()
+{
+  resetFlags = MCUSR;
+  MCUSR = 0;
+  // a watchdog reset leaves the watchdog running at its shortest period
+  wdt_disable();
+}
+#endif
+
+static uint8_t* heapTop()
+{
+  uint8_t* top;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    top = __brkval != nullptr ? (uint8_t*) __brkval : &_end;
+  }
+  return top;
+}
+
+static uint16_t heapUsed()
+{
+  return heapTop() - (uint8_t*) __malloc_heap_start;
+}
+
+/*
+ * Counts untouched paint upwards from the heap top and repaints the gap up
+ * to just below the current stack pointer. ISRs that fire while painting
+ * only ever push below SP and return before we continue, so painting
+ * without disabling interrupts is safe.
+ */
+static uint16_t measureStackHeadroom()
+{
+  uint8_t* bottom = heapTop();
+  uint8_t* limit = (uint8_t*) (uintptr_t) SP - MEMDIAG_STACK_GUARD;
+  uint8_t* cursor = bottom;
+  while (cursor < limit && *cursor == MEMDIAG_PAINT) {
+    cursor++;
+  }
+  uint16_t headroom = cursor - bottom;
+
+  for (uint8_t* paint = cursor; paint < limit; paint++) {
+    *paint = MEMDIAG_PAINT;
+  }
+  return headroom;
+}
+
+static void bookSample(uint8_t phase)
+{
+  MemDiagPhase& stats = memDiag.phases[phase];
+  uint16_t headroom = measureStackHeadroom();
+  uint16_t heap = heapUsed();
+  if (headroom < stats.stackHeadroom) {
+    stats.stackHeadroom = headroom;
+  }
+  if (stats.heapPeak == MEMDIAG_UNTOUCHED || heap > stats.heapPeak) {
+    stats.heapPeak = heap;
+  }
+  memDiag.lastPhase = phase;
+}
+
+static void resetStats()
+{
+  memDiag.magic = MEMDIAG_MAGIC;
+  memDiag.lastPhase = 0;
+  for (uint8_t i = 0; i < MEMDIAG_PHASES; i++) {
+    memDiag.phases[i].stackHeadroom = MEMDIAG_UNTOUCHED;
+    memDiag.phases[i].heapPeak = MEMDIAG_UNTOUCHED;
+  }
+}
+
+void memDiagBegin()
+{
+#ifdef MEMDIAG_PERSIST
+  if (memDiag.magic == MEMDIAG_MAGIC && !(resetFlags & _BV(PORF))) {
+    LOG_WARN(MEMDIAG_PREVIOUS, resetFlags, memDiag.lastPhase,
+      memDiag.phases[memDiag.lastPhase].stackHeadroom);
+    for (uint8_t i = 0; i < MEMDIAG_PHASES; i++) {
+      if (memDiag.phases[i].stackHeadroom != MEMDIAG_UNTOUCHED) {
+        LOG_INFO(MEMDIAG_PHASE, i, memDiag.phases[i].stackHeadroom, memDiag.phases[i].heapPeak);
+      }
+    }
+  }
+#endif
+  resetStats();
+  lastSample = millis();
+}
+
+/*
+ * Call once per loop() with the current game phase. Measures on every
+ * phase change and otherwise at most every MEMDIAG_SAMPLE_INTERVAL ms.
+ */
+void memDiagSample(uint8_t phase)
+{
+  if (phase >= MEMDIAG_PHASES) {
+    phase = MEMDIAG_PHASES - 1;
+  }
+  if (phase == currentPhase && millis() - lastSample < MEMDIAG_SAMPLE_INTERVAL) {
+    return;
+  }
+  // Whatever happened since the last sample belongs to the phase it ran in
+  bookSample(currentPhase);
+  if (phase != currentPhase) {
+    LOG_DEBUG(MEMDIAG_PHASE, currentPhase,
+      memDiag.phases[currentPhase].stackHeadroom, memDiag.phases[currentPhase].heapPeak);
+  }
+  currentPhase = phase;
+  lastSample = millis();
+}
+
+void memDiagReport()
+{
+  bookSample(currentPhase);
+  for (uint8_t i = 0; i < MEMDIAG_PHASES; i++) {
+    if (memDiag.phases[i].stackHeadroom != MEMDIAG_UNTOUCHED) {
+      LOG_INFO(MEMDIAG_PHASE, i, memDiag.phases[i].stackHeadroom, memDiag.phases[i].heapPeak);
+    }
+  }
+  MemDiagHeap heap = memDiagHeap();
+  LOG_INFO(MEMDIAG_HEAP, heap.freeBytes, heap.freeBlocks, heap.largestFree);
+}
+
+const MemDiagPhase& memDiagPhase(uint8_t phase)
+{
+  return memDiag.phases[phase < MEMDIAG_PHASES ? phase : MEMDIAG_PHASES - 1];
+}
+
+/*
+ * Walks the malloc free list. Free bytes below __brkval that are split
+ * over many blocks mean the heap is fragmenting.
+ */
+MemDiagHeap memDiagHeap()
+{
+  MemDiagHeap heap = { 0, 0, 0 };
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    for (struct __freelist* block = __flp; block != nullptr; block = block->nx) {
+      uint16_t size = block->sz + sizeof(size_t);
+      heap.freeBytes += size;
+      heap.freeBlocks++;
+      if (size > heap.largestFree) {
+        heap.largestFree = size;
+      }
+    }
+  }
+  return heap;
+}
+
+uint8_t memDiagResetFlags()
+{
+  return resetFlags;
+}
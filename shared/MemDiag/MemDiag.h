@@ -0,0 +1,43 @@
+#ifndef MEM_DIAG_H
+#define MEM_DIAG_H
+
+#include <Arduino.h>
+
+/*
+ * Stack and heap watermarks per game phase.
+ *
+ * The free RAM between heap and stack is painted with MEMDIAG_PAINT before
+ * main() runs. memDiagSample() measures how much paint is left above the
+ * heap (the stack headroom), the heap high-water mark and the free list,
+ * and books them to the current phase. After each measurement the gap is
+ * repainted, so every phase gets its own stack watermark.
+ *
+ * With MEMDIAG_PERSIST defined the statistics live in .noinit and the ones
+ * from before a watchdog or external reset are logged by memDiagBegin().
+ */
+
+#define MEMDIAG_PAINT 0xC5
+#define MEMDIAG_PHASES 12
+#define MEMDIAG_SAMPLE_INTERVAL 250
+#define MEMDIAG_STACK_GUARD 32
+
+struct MemDiagPhase {
+  uint16_t stackHeadroom;
+  uint16_t heapPeak;
+};
+
+struct MemDiagHeap {
+  uint16_t freeBytes;
+  uint16_t largestFree;
+  uint8_t freeBlocks;
+};
+
+void memDiagBegin();
+void memDiagSample(uint8_t phase);
+void memDiagReport();
+
+const MemDiagPhase& memDiagPhase(uint8_t phase);
+MemDiagHeap memDiagHeap();
+uint8_t memDiagResetFlags();
+
+#endif
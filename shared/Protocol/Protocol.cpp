@@ -0,0 +1,40 @@
+#include "Protocol.h"
+
+uint8_t protocolChecksum(const uint8_t* frame, uint8_t length)
+{
+  uint8_t checksum = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    checksum ^= frame[i];
+  }
+  return checksum;
+}
+
+/*
+ * Validates a received frame against its table entry and calls the handler.
+ * Trailing bytes after the frame are ignored, so the master can read a
+ * fixed PROTOCOL_MAX_UPLINK_FRAME bytes whatever the module has queued.
+ * Nothing past frame[length - 1] is read, whatever the bytes contain.
+ */
+bool protocolDispatch(const ProtocolEntry* table, uint8_t base, uint8_t count,
+                      uint8_t source, const uint8_t* frame, uint8_t length)
+{
+  if (length == 0) {
+    return false;
+  }
+  uint8_t index = frame[0] - base;
+  if (index >= count) {
+    return false;
+  }
+
+  ProtocolEntry entry;
+  memcpy_P(&entry, &table[index], sizeof(entry));
+  if (length < entry.frameLength) {
+    return false;
+  }
+  if (protocolChecksum(frame, entry.frameLength - 1) != frame[entry.frameLength - 1]) {
+    return false;
+  }
+
+  entry.handler(source, frame + 1);
+  return true;
+}
@@ -0,0 +1,311 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+#include <BombConstants.h>
+
+#ifdef ARDUINO
+#include <avr/pgmspace.h>
+#else
+// Host builds, e.g. a test or fuzz harness linking Protocol.cpp
+#define PROGMEM
+#define memcpy_P memcpy
+#endif
+
+/*
+ * Binary protocol between master and modules.
+ *
+ * Every message is declared exactly once in the tables below. The tables
+ * expand into a <Name>Message struct, an opcode, protocolEncode() and
+ * protocolDecode() overloads and a dispatch table per direction, so the
+ * master and the modules cannot disagree about a message's layout: a
+ * renamed or retyped field breaks the build on both sides.
+ *
+ * Frame layout (at most PROTOCOL_MAX_FRAME bytes, one Wire transmission):
+ *   0      opcode
+ *   1..n   fields in declaration order, multi-byte values little endian
+ *   n+1    XOR of bytes 0..n
+ *
+ * Downlink opcodes (master to module) count up from 0x01, uplink opcodes
+ * (module to master) from 0x80, both in table order. 0x00 means "nothing
+ * to send". Append new messages at the end of a table so deployed modules
+ * keep their opcodes.
+ *
+ * The receiving firmware implements on<Name>(source, message) for every
+ * message of its direction; protocolDispatch<Direction>() validates the
+ * frame and calls it through a jump table indexed by the opcode.
+ */
+
+#define PROTOCOL_MAX_FRAME 32
+#define PROTOCOL_MAX_LABELS 4
+
+#define PROTOCOL_OP_NONE 0x00
+#define PROTOCOL_DOWNLINK_BASE 0x01
+#define PROTOCOL_UPLINK_BASE 0x80
+
+// Provision label codes: label id, PROTOCOL_LABEL_LIT if lit
+#define PROTOCOL_LABEL_LIT 0x80
+#define PROTOCOL_LABEL_NONE 0xFF
+
+// Rematch fields that differ from the previous game
+#define PROTOCOL_REMATCH_LIVES 0x01
+#define PROTOCOL_REMATCH_TIME 0x02
+
+// Every module boots on the default address until the master assigns it one
+// from PROTOCOL_FIRST_ADDRESS upwards, see AssignAddress. ReleaseAddress
+// sends it back, for a master that reset and lost its roster
+#define PROTOCOL_DEFAULT_ADDRESS 0x08
+#define PROTOCOL_FIRST_ADDRESS 0x10
+
+// Bus clocks a module can advertise in IdentReply
+#define PROTOCOL_BUS_STANDARD_KHZ 100
+#define PROTOCOL_BUS_FAST_KHZ 400
+
+/* MESSAGES */
+#define PROTOCOL_NO_FIELDS(FIELD, ARRAY)
+
+#define PROTOCOL_PROVISION_FIELDS(FIELD, ARRAY) \
+  ARRAY(char, serial, SERIAL_NUMBER_LENGTH) \
+  ARRAY(uint8_t, labels, PROTOCOL_MAX_LABELS) \
+  FIELD(uint8_t, lives) \
+  FIELD(uint16_t, time) \
+  FIELD(uint32_t, seed) \
+  ARRAY(uint8_t, ports, PORT_COUNT) \
+  ARRAY(uint8_t, batteries, BATTERY_COUNT)
+
+#define PROTOCOL_NEEDY_ACTIVATE_FIELDS(FIELD, ARRAY) \
+  FIELD(uint16_t, seconds)
+
+#define PROTOCOL_REMATCH_FIELDS(FIELD, ARRAY) \
+  FIELD(uint32_t, seed) \
+  FIELD(uint8_t, changed) \
+  FIELD(uint8_t, lives) \
+  FIELD(uint16_t, time)
+
+#define PROTOCOL_ASSIGN_ADDRESS_FIELDS(FIELD, ARRAY) \
+  FIELD(uint8_t, address)
+
+// Game time as the clock shows it, which runs faster with every strike
+#define PROTOCOL_TIME_SYNC_FIELDS(FIELD, ARRAY) \
+  FIELD(uint32_t, remainingMillis) \
+  FIELD(uint8_t, strikes)
+
+#define PROTOCOL_IDENT_REPLY_FIELDS(FIELD, ARRAY) \
+  FIELD(uint8_t, type) \
+  FIELD(bool, needy) \
+  FIELD(uint16_t, maxBusKHz) \
+  FIELD(uint8_t, maxFrame)
+
+#define PROTOCOL_DOWNLINK(MSG) \
+  MSG(Ping, PROTOCOL_NO_FIELDS) \
+  MSG(EnableRequestPin, PROTOCOL_NO_FIELDS) \
+  MSG(DisableRequestPin, PROTOCOL_NO_FIELDS) \
+  MSG(Ident, PROTOCOL_NO_FIELDS) \
+  MSG(Provision, PROTOCOL_PROVISION_FIELDS) \
+  MSG(NeedyActivate, PROTOCOL_NEEDY_ACTIVATE_FIELDS) \
+  MSG(NeedyDeactivate, PROTOCOL_NO_FIELDS) \
+  MSG(Rematch, PROTOCOL_REMATCH_FIELDS) \
+  MSG(AssignAddress, PROTOCOL_ASSIGN_ADDRESS_FIELDS) \
+  MSG(ReleaseAddress, PROTOCOL_NO_FIELDS) \
+  MSG(TimeSync, PROTOCOL_TIME_SYNC_FIELDS)
+
+#define PROTOCOL_UPLINK(MSG) \
+  MSG(IdentReply, PROTOCOL_IDENT_REPLY_FIELDS) \
+  MSG(Ready, PROTOCOL_NO_FIELDS) \
+  MSG(Mistake, PROTOCOL_NO_FIELDS) \
+  MSG(Solved, PROTOCOL_NO_FIELDS)
+
+/* OPCODES */
+#define PROTOCOL_OPCODE(name, fields) PROTOCOL_OP_##name,
+
+enum ProtocolDownlinkOpcode : uint8_t {
+  PROTOCOL_DOWNLINK_FIRST = PROTOCOL_DOWNLINK_BASE - 1,
+  PROTOCOL_DOWNLINK(PROTOCOL_OPCODE)
+  PROTOCOL_DOWNLINK_END
+};
+
+enum ProtocolUplinkOpcode : uint8_t {
+  PROTOCOL_UPLINK_FIRST = PROTOCOL_UPLINK_BASE - 1,
+  PROTOCOL_UPLINK(PROTOCOL_OPCODE)
+  PROTOCOL_UPLINK_END
+};
+
+#define PROTOCOL_DOWNLINK_COUNT (PROTOCOL_DOWNLINK_END - PROTOCOL_DOWNLINK_BASE)
+#define PROTOCOL_UPLINK_COUNT (PROTOCOL_UPLINK_END - PROTOCOL_UPLINK_BASE)
+
+static_assert(PROTOCOL_DOWNLINK_END <= PROTOCOL_UPLINK_BASE, "downlink opcodes overlap the uplink range");
+
+/* FIELD CODING */
+template <typename T>
+inline void protocolPut(uint8_t*& out, T value)
+{
+  static_assert(sizeof(T) <= 4, "protocol fields are at most 32 bits");
+  uint32_t bits = (uint32_t) value;
+  for (uint8_t i = 0; i < sizeof(T); i++) {
+    *out++ = bits;
+    bits >>= 8;
+  }
+}
+
+template <typename T, uint8_t N>
+inline void protocolPut(uint8_t*& out, const T (&values)[N])
+{
+  for (uint8_t i = 0; i < N; i++) {
+    protocolPut(out, values[i]);
+  }
+}
+
+template <typename T>
+inline void protocolGet(const uint8_t*& in, T& value)
+{
+  static_assert(sizeof(T) <= 4, "protocol fields are at most 32 bits");
+  uint32_t bits = 0;
+  for (uint8_t i = 0; i < sizeof(T); i++) {
+    bits |= (uint32_t) *in++ << (8 * i);
+  }
+  value = (T) bits;
+}
+
+template <typename T, uint8_t N>
+inline void protocolGet(const uint8_t*& in, T (&values)[N])
+{
+  for (uint8_t i = 0; i < N; i++) {
+    protocolGet(in, values[i]);
+  }
+}
+
+uint8_t protocolChecksum(const uint8_t* frame, uint8_t length);
+
+/* GENERATED PER MESSAGE */
+#define PROTOCOL_STRUCT_FIELD(type, name) type name;
+#define PROTOCOL_STRUCT_ARRAY(type, name, count) type name[count];
+#define PROTOCOL_SIZE_FIELD(type, name) + sizeof(type)
+#define PROTOCOL_SIZE_ARRAY(type, name, count) + sizeof(type) * (count)
+#define PROTOCOL_PUT_FIELD(type, name) protocolPut(out, message.name);
+#define PROTOCOL_PUT_ARRAY(type, name, count) protocolPut(out, message.name);
+#define PROTOCOL_GET_FIELD(type, name) protocolGet(in, message.name);
+#define PROTOCOL_GET_ARRAY(type, name, count) protocolGet(in, message.name);
+
+#define PROTOCOL_MESSAGE(name, fields) \
+  struct name##Message { \
+    static constexpr uint8_t OPCODE = PROTOCOL_OP_##name; \
+    static constexpr uint8_t FRAME_LENGTH = 2 fields(PROTOCOL_SIZE_FIELD, PROTOCOL_SIZE_ARRAY); \
+    fields(PROTOCOL_STRUCT_FIELD, PROTOCOL_STRUCT_ARRAY) \
+  }; \
+  static_assert(name##Message::FRAME_LENGTH <= PROTOCOL_MAX_FRAME, #name " does not fit a frame"); \
+  inline uint8_t protocolEncode(const name##Message& message, uint8_t* frame) \
+  { \
+    uint8_t* out = frame; \
+    *out++ = name##Message::OPCODE; \
+    fields(PROTOCOL_PUT_FIELD, PROTOCOL_PUT_ARRAY) \
+    (void) message; \
+    *out = protocolChecksum(frame, name##Message::FRAME_LENGTH - 1); \
+    return name##Message::FRAME_LENGTH; \
+  } \
+  inline void protocolDecode(const uint8_t* payload, name##Message& message) \
+  { \
+    const uint8_t* in = payload; \
+    fields(PROTOCOL_GET_FIELD, PROTOCOL_GET_ARRAY) \
+    (void) in; \
+    (void) message; \
+  } \
+  void on##name(uint8_t source, const name##Message& message); \
+  inline void protocolHandle##name(uint8_t source, const uint8_t* payload) \
+  { \
+    name##Message message; \
+    protocolDecode(payload, message); \
+    on##name(source, message); \
+  }
+
+PROTOCOL_DOWNLINK(PROTOCOL_MESSAGE)
+PROTOCOL_UPLINK(PROTOCOL_MESSAGE)
+
+/* DISPATCH */
+typedef void (*ProtocolHandler)(uint8_t source, const uint8_t* payload);
+
+struct ProtocolEntry {
+  uint8_t frameLength;
+  ProtocolHandler handler;
+};
+
+#define PROTOCOL_ENTRY(name, fields) { name##Message::FRAME_LENGTH, protocolHandle##name },
+
+bool protocolDispatch(const ProtocolEntry* table, uint8_t base, uint8_t count,
+                      uint8_t source, const uint8_t* frame, uint8_t length);
+
+// The longest frame of each direction, for sizing receive buffers
+#define PROTOCOL_FRAME_MEMBER(name, fields) uint8_t name[name##Message::FRAME_LENGTH];
+union ProtocolDownlinkFrames { PROTOCOL_DOWNLINK(PROTOCOL_FRAME_MEMBER) };
+union ProtocolUplinkFrames { PROTOCOL_UPLINK(PROTOCOL_FRAME_MEMBER) };
+#define PROTOCOL_MAX_DOWNLINK_FRAME sizeof(ProtocolDownlinkFrames)
+#define PROTOCOL_MAX_UPLINK_FRAME sizeof(ProtocolUplinkFrames)
+
+/* RECEIVE */
+// Source is anything read like Wire after a transmission: available(), read()
+template <typename Source>
+inline uint8_t protocolCopy(Source& source, uint8_t* frame, uint8_t capacity)
+{
+  uint8_t length = 0;
+  while (source.available() && length < capacity) {
+    frame[length++] = source.read();
+  }
+  return length;
+}
+
+/*
+ * A module takes a master transmission into a PROTOCOL_MAX_DOWNLINK_FRAME
+ * buffer. An empty one is a probe and one longer than any downlink frame is
+ * refused rather than truncated into something that might still pass as a
+ * shorter frame. Returns the frame length, 0 if refused.
+ */
+template <typename Source>
+inline uint8_t protocolReceiveDownlink(Source& source, uint8_t* frame)
+{
+  int available = source.available();
+  if (available == 0 || available > (int) PROTOCOL_MAX_DOWNLINK_FRAME) {
+    return 0;
+  }
+  return protocolCopy(source, frame, PROTOCOL_MAX_DOWNLINK_FRAME);
+}
+
+// The master takes at most one uplink frame of whatever a module sends
+template <typename Source>
+inline uint8_t protocolReceiveUplink(Source& source, uint8_t* frame)
+{
+  return protocolCopy(source, frame, PROTOCOL_MAX_UPLINK_FRAME);
+}
+
+/*
+ * Only the firmware that receives a direction calls its dispatch function,
+ * so only that side needs the on<Name>() handlers for it.
+ */
+inline bool protocolDispatchDownlink(uint8_t source, const uint8_t* frame, uint8_t length)
+{
+  static const ProtocolEntry table[PROTOCOL_DOWNLINK_COUNT] PROGMEM = {
+    PROTOCOL_DOWNLINK(PROTOCOL_ENTRY)
+  };
+  return protocolDispatch(table, PROTOCOL_DOWNLINK_BASE, PROTOCOL_DOWNLINK_COUNT, source, frame, length);
+}
+
+inline bool protocolDispatchUplink(uint8_t source, const uint8_t* frame, uint8_t length)
+{
+  static const ProtocolEntry table[PROTOCOL_UPLINK_COUNT] PROGMEM = {
+    PROTOCOL_UPLINK(PROTOCOL_ENTRY)
+  };
+  return protocolDispatch(table, PROTOCOL_UPLINK_BASE, PROTOCOL_UPLINK_COUNT, source, frame, length);
+}
+
+/* LABELS */
+inline uint8_t protocolPackLabel(const Label& label)
+{
+  return label.label | (label.lit ? PROTOCOL_LABEL_LIT : 0);
+}
+
+inline Label protocolUnpackLabel(uint8_t code)
+{
+  Label label = { (uint8_t) (code & ~PROTOCOL_LABEL_LIT), (code & PROTOCOL_LABEL_LIT) != 0 };
+  return label;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LOG_MESSAGES_H
+#define LOG_MESSAGES_H
+
+#include <stdint.h>
+
+/*
+ * Log message catalog shared by all firmwares and by tools/logdecode.py.
+ * The position in this list is the token sent on the wire, so only ever
+ * append new messages. Formats use printf syntax, arguments are integers.
+ */
+#define LOG_MESSAGES(MSG) \
+  MSG(LOG_DROPPED, "%d log records dropped") \
+  MSG(BOOT, "Boot") \
+  MSG(DISCOVERY_START, "Starting I2C discovery") \
+  MSG(DISCOVERY_DONE, "I2C scan complete, found %d modules") \
+  MSG(MODULE_FOUND, "Module #%d @ 0x%02x with request pin %d") \
+  MSG(MODULE_ENABLED, "Enabled module @ 0x%02x") \
+  MSG(MODULE_LOST, "Lost module @ 0x%02x") \
+  MSG(COMMAND_SENT, "Sent %d byte command to 0x%02x") \
+  MSG(REQUEST_INTERRUPT, "Interrupt received from pin %d") \
+  MSG(PROVISION_SENT, "Provisioned modules with %d byte command") \
+  MSG(AUDIO_NO_SD, "SD card not found, audio disabled") \
+  MSG(COMMAND_RECEIVED, "Received %d byte command") \
+  MSG(REPLY_SENT, "Reply sent") \
+  MSG(PROVISIONED, "Module provisioned") \
+  MSG(READY_PREPARED, "Ready prepared") \
+  MSG(REQUEST_STARTED, "Started request") \
+  MSG(JSON_ARENA, "JSON arena peak %d of %d bytes, %d failed allocations") \
+  MSG(MEMDIAG_PHASE, "Phase %d: %d bytes stack headroom, heap peak %d bytes") \
+  MSG(MEMDIAG_HEAP, "Heap free list: %d bytes in %d blocks, largest %d") \
+  MSG(MEMDIAG_PREVIOUS, "Reset flags 0x%02x, previous run ended in phase %d with %d bytes stack headroom") \
+  MSG(LOOP_OVERRUN, "Loop took %d us in state %d, %d overruns so far") \
+  MSG(PROFILE_SECTION, "Section %d: %d calls, average %d us") \
+  MSG(PROFILE_RANGE, "Section %d: min %d us, max %d us") \
+  MSG(PROFILE_BUCKET, "Section %d: %d calls under %d us") \
+  MSG(PROFILE_OVERRUNS, "%d loop overruns over a %d us budget") \
+  MSG(REMATCH_SENT, "Rematch sent to %d modules, changed 0x%02x") \
+  MSG(PUZZLE_READY, "Puzzle precomputed in %d us") \
+  MSG(PUZZLE_BUTTON, "Button colour %d, label %d, strip %d") \
+  MSG(ADDRESS_ASSIGNED, "Moved to bus address 0x%02x") \
+  MSG(BUS_TIMEOUT, "Bus timeout talking to 0x%02x") \
+  MSG(MODULE_SUSPECT, "Module @ 0x%02x missed a heartbeat") \
+  MSG(MODULE_FAILED, "Module @ 0x%02x failed") \
+  MSG(MODULE_RECOVERED, "Re-provisioned module @ 0x%02x in %d ms") \
+  MSG(COMMAND_DROPPED, "%d commands dropped, previous one still pending") \
+  MSG(BUS_SPEED, "Module @ 0x%02x at %d kHz, frames up to %d bytes") \
+  MSG(BUS_FALLBACK, "Module @ 0x%02x falls back to %d kHz") \
+  MSG(FRAME_TOO_LONG, "%d byte command too long for 0x%02x") \
+  MSG(GAME_RESUMED, "Resumed game from snapshot %d with %d s left and %d strikes") \
+  MSG(WAKE_LATENCY, "First bus event %d us after waking, worst so far") \
+  MSG(WAKE_OVER_BUDGET, "First bus event %d us after waking, over budget %d times in a row") \
+  MSG(COMMAND_OVERLONG, "Ignored a %d byte command, longer than any frame") \
+  MSG(STANDBY_DISABLED, "Standby disabled after %d wakes over budget in a row") \
+  MSG(PROFILE_BUCKET_OVER, "Section %d: %d calls at >= %d us") \
+  MSG(ADDRESS_RELEASED, "Released bus address 0x%02x") \
+  MSG(ADDRESS_RECLAIMED, "Reclaimed module on bus address 0x%02x") \
+  MSG(RESUME_REFUSED, "Snapshot %d not resumed, request lines 0x%02x then, 0x%02x now")
+
+#define LOG_MESSAGE_ID(name, format) LOG_##name,
+enum LogMessage : uint8_t {
+  LOG_MESSAGES(LOG_MESSAGE_ID)
+  LOG_MESSAGE_COUNT
+};
+#undef LOG_MESSAGE_ID
+
+#endif
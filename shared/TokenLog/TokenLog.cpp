@@ -0,0 +1,123 @@
+#include "TokenLog.h"
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+
+#include <util/atomic.h>
+
+#define LOG_MAX_RECORD_SIZE (3 + 5 + 5 * LOG_MAX_ARGUMENTS)
+
+static uint8_t logBuffer[LOG_BUFFER_SIZE];
+static volatile uint16_t logHead = 0;
+static volatile uint16_t logTail = 0;
+static volatile uint16_t logDropped = 0;
+
+static uint8_t putVarint(uint8_t* out, uint32_t value)
+{
+  uint8_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  out[length++] = value;
+  return length;
+}
+
+static void logRecord(uint8_t level, uint8_t message, uint8_t count, const int32_t* arguments)
+{
+  uint8_t record[LOG_MAX_RECORD_SIZE];
+  uint8_t length = 0;
+  record[length++] = LOG_SYNC;
+  record[length++] = message;
+  record[length++] = (level << 4) | count;
+  length += putVarint(record + length, millis());
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t zigzag = ((uint32_t) arguments[i] << 1) ^ (uint32_t) (arguments[i] >> 31);
+    length += putVarint(record + length, zigzag);
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    uint16_t used = (logHead - logTail + LOG_BUFFER_SIZE) % LOG_BUFFER_SIZE;
+    if (LOG_BUFFER_SIZE - 1 - used < length) {
+      logDropped++;
+    } else {
+      uint16_t head = logHead;
+      for (uint8_t i = 0; i < length; i++) {
+        logBuffer[head] = record[i];
+        head = (head + 1) % LOG_BUFFER_SIZE;
+      }
+      logHead = head;
+    }
+  }
+}
+
+void logBegin()
+{
+  Serial.begin(LOG_BAUD);
+}
+
+/*
+ * True once every record has been handed to Serial. Serial.flush() then
+ * waits for the last byte to leave before the USART clock may be stopped.
+ */
+bool logIdle()
+{
+  return logHead == logTail && logDropped == 0;
+}
+
+/*
+ * Writes only what fits into the Serial TX buffer right now.
+ */
+void logFlush()
+{
+  uint16_t dropped;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    dropped = logDropped;
+    logDropped = 0;
+  }
+  if (dropped > 0) {
+    logWrite(LOG_LEVEL_WARN, LOG_LOG_DROPPED, dropped);
+  }
+
+  uint16_t head;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    head = logHead;
+  }
+
+  int space = Serial.availableForWrite();
+  while (space > 0 && logTail != head) {
+    uint16_t tail = logTail;
+    uint16_t end = head > tail ? head : LOG_BUFFER_SIZE;
+    uint16_t length = end - tail;
+    if (length > (uint16_t) space) {
+      length = space;
+    }
+    Serial.write(logBuffer + tail, length);
+    space -= length;
+    logTail = (tail + length) % LOG_BUFFER_SIZE;
+  }
+}
+
+void logWrite(uint8_t level, uint8_t message)
+{
+  logRecord(level, message, 0, nullptr);
+}
+
+void logWrite(uint8_t level, uint8_t message, int32_t a)
+{
+  int32_t arguments[] = { a };
+  logRecord(level, message, 1, arguments);
+}
+
+void logWrite(uint8_t level, uint8_t message, int32_t a, int32_t b)
+{
+  int32_t arguments[] = { a, b };
+  logRecord(level, message, 2, arguments);
+}
+
+void logWrite(uint8_t level, uint8_t message, int32_t a, int32_t b, int32_t c)
+{
+  int32_t arguments[] = { a, b, c };
+  logRecord(level, message, 3, arguments);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef TOKEN_LOG_H
+#define TOKEN_LOG_H
+
+#include <Arduino.h>
+
+/*
+ * Tokenized, non-blocking logging.
+ *
+ * A log call stores the message token and its integer arguments as a
+ * binary record in a RAM ring buffer; nothing is formatted on the device.
+ * logFlush() moves as many bytes to Serial as fit in its TX buffer without
+ * waiting, so it is safe to call from loop() on every iteration. Logging
+ * from an ISR is allowed.
+ *
+ * Calls above LOG_LEVEL compile to nothing, LOG_LEVEL_NONE also removes
+ * the ring buffer and Serial. Decode the stream with tools/logdecode.py.
+ *
+ * Record layout:
+ *   LOG_SYNC, token, level << 4 | argument count,
+ *   varint milliseconds, zigzag varint per argument
+ */
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 128
+#endif
+
+#define LOG_BAUD 250000
+#define LOG_SYNC 0xA5
+#define LOG_MAX_ARGUMENTS 3
+
+#include "LogMessages.h"
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+void logBegin();
+void logFlush();
+bool logIdle();
+void logWrite(uint8_t level, uint8_t message);
+void logWrite(uint8_t level, uint8_t message, int32_t a);
+void logWrite(uint8_t level, uint8_t message, int32_t a, int32_t b);
+void logWrite(uint8_t level, uint8_t message, int32_t a, int32_t b, int32_t c);
+#else
+inline void logBegin() {}
+inline void logFlush() {}
+inline bool logIdle() { return true; }
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(message, ...) logWrite(LOG_LEVEL_ERROR, LOG_##message, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(message, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(message, ...) logWrite(LOG_LEVEL_WARN, LOG_##message, ##__VA_ARGS__)
+#else
+#define LOG_WARN(message, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(message, ...) logWrite(LOG_LEVEL_INFO, LOG_##message, ##__VA_ARGS__)
+#else
+#define LOG_INFO(message, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(message, ...) logWrite(LOG_LEVEL_DEBUG, LOG_##message, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(message, ...) do {} while (0)
+#endif
+
+#endif
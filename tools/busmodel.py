@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Models I2C bus time per protocol message at the supported bus clocks.
+
+Usage:
+  busmodel.py [modules]    modules on the bus, default 8
+
+Frame lengths are read from shared/Protocol/Protocol.h, so the model follows
+the schema. A write costs the address byte plus the frame, a read always
+requests PROTOCOL_MAX_UPLINK_FRAME bytes, as readFromModule() does. Every
+byte is 9 clocks plus the time the module's TWI interrupt stretches the
+clock, start and stop take about one clock each.
+
+Exits non-zero when any transaction takes longer than BUS_TIMEOUT_MICROS in
+master/src/main.cpp, since Wire would abort it at that bus clock.
+"""
+
+import os
+import re
+import sys
+
+SHARED = os.path.join(os.path.dirname(__file__), "..", "shared")
+PROTOCOL = os.path.join(SHARED, "Protocol", "Protocol.h")
+CONSTANTS = os.path.join(SHARED, "BombConstants", "BombConstants.h")
+MASTER = os.path.join(os.path.dirname(__file__), "..", "master", "src", "main.cpp")
+TYPE_SIZES = {"bool": 1, "char": 1, "uint8_t": 1, "uint16_t": 2, "uint32_t": 4}
+SPEEDS_KHZ = (100, 400)
+STRETCH_MICROS = 4.0  # per byte, AVR Wire slave ISR at 16 MHz (estimate)
+
+
+def load_constants(*paths):
+    constants = {}
+    for path in paths:
+        with open(path) as header:
+            text = header.read()
+        for name, value in re.findall(r"#define (\w+) (\d+|0x[0-9A-Fa-f]+)\b", text):
+            constants[name] = int(value, 0)
+        for body in re.findall(r"enum \w+ : uint8_t \{([^}]*)\}", text):
+            for index, name in enumerate(re.findall(r"(\w+)\s*,?", body)):
+                constants[name] = index
+    return constants
+
+
+def load_messages(path, constants):
+    with open(path) as header:
+        text = header.read().replace("\\\n", "")
+    fields = {}
+    for name, body in re.findall(r"#define (PROTOCOL_\w+_FIELDS)\(FIELD, ARRAY\)(.*)", text):
+        length = 0
+        for kind, arguments in re.findall(r"(FIELD|ARRAY)\(([^)]*)\)", body):
+            parts = [part.strip() for part in arguments.split(",")]
+            count = constants[parts[2]] if kind == "ARRAY" else 1
+            length += TYPE_SIZES[parts[0]] * count
+        fields[name] = length
+    messages = {}
+    for direction in ("DOWNLINK", "UPLINK"):
+        table = re.search(r"#define PROTOCOL_%s\(MSG\)(.*)" % direction, text).group(1)
+        # opcode + fields + checksum
+        messages[direction] = [(name, 2 + fields[fieldList])
+                               for name, fieldList in re.findall(r"MSG\((\w+), (\w+)\)", table)]
+    return messages
+
+
+def load_bus_timeout(path):
+    with open(path) as source:
+        return int(re.search(r"BUS_TIMEOUT_MICROS = (\d+);", source.read()).group(1))
+
+
+def transaction_micros(payload, kHz):
+    clock = 1000.0 / kHz
+    return 2 * clock + (1 + payload) * (9 * clock + STRETCH_MICROS)
+
+
+def main():
+    if len(sys.argv) > 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+    modules = int(sys.argv[1]) if len(sys.argv) == 2 else 8
+    messages = load_messages(PROTOCOL, load_constants(CONSTANTS, PROTOCOL))
+    read_length = max(length for _, length in messages["UPLINK"])
+
+    header = "%-20s %6s" % ("message", "bytes") + "".join("%10d kHz" % speed for speed in SPEEDS_KHZ)
+    print(header)
+    for name, length in messages["DOWNLINK"]:
+        print("%-20s %6d" % (name, length)
+              + "".join("%11.0f us" % transaction_micros(length, speed) for speed in SPEEDS_KHZ))
+    print("%-20s %6d" % ("read (any uplink)", read_length)
+          + "".join("%11.0f us" % transaction_micros(read_length, speed) for speed in SPEEDS_KHZ))
+    print("%-20s %6d" % ("probe", 0)
+          + "".join("%11.0f us" % transaction_micros(0, speed) for speed in SPEEDS_KHZ))
+
+    provision = dict(messages["DOWNLINK"])["Provision"]
+    print()
+    print("Provisioning %d modules:" % modules
+          + "".join("%11.0f us" % (modules * transaction_micros(provision, speed)) for speed in SPEEDS_KHZ))
+    print("Heartbeat round, %d probes:" % modules
+          + "".join("%11.0f us" % (modules * transaction_micros(0, speed)) for speed in SPEEDS_KHZ))
+
+    timeout = load_bus_timeout(MASTER)
+    transactions = messages["DOWNLINK"] + [("read (any uplink)", read_length)]
+    overlong = [(name, speed, transaction_micros(length, speed))
+                for name, length in transactions for speed in SPEEDS_KHZ
+                if transaction_micros(length, speed) > timeout]
+    print()
+    print("Wire timeout: %d us" % timeout)
+    for name, speed, micros in overlong:
+        print("%s at %d kHz takes %.0f us and would be aborted" % (name, speed, micros), file=sys.stderr)
+    return 1 if overlong else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
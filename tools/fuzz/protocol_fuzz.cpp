@@ -0,0 +1,319 @@
+/*
+ * Fuzz target for the frame parser in shared/Protocol.
+ *
+ * The input is cut into Wire transmissions: a length byte, then that many
+ * bytes, repeated. Each transmission is read with the receive functions the
+ * firmware calls (protocolReceiveDownlink() in the module's
+ * receiveMessage(), protocolReceiveUplink() in the master's
+ * readFromModule()) and then dispatched. The length byte is not capped at
+ * the frame size, so overlong, empty and truncated transmissions all come
+ * up. Every frame that dispatches is re-encoded from the decoded message and
+ * must give back the received frame byte for byte, except that bool fields
+ * come back as 0 or 1, and dispatch again.
+ *
+ * libFuzzer, from the repository root:
+ *   clang++ -std=gnu++11 -g -O1 -fsanitize=fuzzer,address,undefined \
+ *     -Ishared/Protocol -Ishared/BombConstants \
+ *     tools/fuzz/protocol_fuzz.cpp shared/Protocol/Protocol.cpp -o protocol_fuzz
+ *   ./protocol_fuzz -max_len=512
+ *
+ * Without libFuzzer, -DSTANDALONE builds a main() that replays the files
+ * given as arguments, or runs random inputs when there are none:
+ *   g++ -std=gnu++11 -g -O1 -fsanitize=address,undefined -DSTANDALONE \
+ *     -Ishared/Protocol -Ishared/BombConstants \
+ *     tools/fuzz/protocol_fuzz.cpp shared/Protocol/Protocol.cpp -o protocol_replay
+ *   ./protocol_replay [inputs...]
+ *
+ * -DTHROUGHPUT builds a main() that reports dispatched messages per second
+ * and the worst time per transmission length, for valid and random frames:
+ *   g++ -std=gnu++11 -O2 -DTHROUGHPUT \
+ *     -Ishared/Protocol -Ishared/BombConstants \
+ *     tools/fuzz/protocol_fuzz.cpp shared/Protocol/Protocol.cpp -o protocol_throughput
+ *   ./protocol_throughput [seconds]
+ *
+ * Host timings say nothing absolute about the AVR, they are for comparing
+ * parser changes against each other.
+ */
+
+#include <Protocol.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* HANDLERS */
+// The frame being dispatched and the message it decoded to
+static const uint8_t* currentFrame = 0;
+static uint8_t encoded[PROTOCOL_MAX_FRAME];
+static uint8_t encodedLength = 0;
+static unsigned long dispatched = 0;
+
+// Steps over one field of the expected frame, decoding turns any bool byte into 0 or 1
+static void normalizeField(uint8_t*& at, bool)
+{
+  *at = *at != 0;
+  at++;
+}
+
+template <typename T>
+static void normalizeField(uint8_t*& at, T)
+{
+  at += sizeof(T);
+}
+
+#define FUZZ_NORMALIZE_FIELD(type, name) normalizeField(at, type());
+#define FUZZ_NORMALIZE_ARRAY(type, name, count) \
+  for (uint8_t i = 0; i < (count); i++) { \
+    normalizeField(at, type()); \
+  }
+
+#define FUZZ_HANDLER(name, fields) \
+  void on##name(uint8_t source, const name##Message& message) \
+  { \
+    const uint8_t length = name##Message::FRAME_LENGTH; \
+    uint8_t expected[PROTOCOL_MAX_FRAME]; \
+    memcpy(expected, currentFrame, length); \
+    uint8_t* at = expected + 1; \
+    fields(FUZZ_NORMALIZE_FIELD, FUZZ_NORMALIZE_ARRAY) \
+    (void) at; \
+    expected[length - 1] = protocolChecksum(expected, length - 1); \
+    encodedLength = protocolEncode(message, encoded); \
+    if (encodedLength != length || memcmp(encoded, expected, length) != 0) { \
+      abort(); \
+    } \
+    dispatched++; \
+  }
+
+PROTOCOL_DOWNLINK(FUZZ_HANDLER)
+PROTOCOL_UPLINK(FUZZ_HANDLER)
+
+/* WIRE */
+// One received transmission, read the way the Wire library hands it out
+struct Transmission {
+  const uint8_t* bytes;
+  size_t length;
+  size_t position;
+
+  int available() const { return (int) (length - position); }
+  uint8_t read() { return bytes[position++]; }
+};
+
+static bool dispatch(bool uplink, const uint8_t* frame, uint8_t length)
+{
+  currentFrame = frame;
+  return uplink ? protocolDispatchUplink(0, frame, length) : protocolDispatchDownlink(0, frame, length);
+}
+
+// Copies into buffers of exactly the received length, so ASan sees any overread
+static void receive(bool uplink, const uint8_t* bytes, size_t length)
+{
+  uint8_t* copy = (uint8_t*) malloc(length ? length : 1);
+  memcpy(copy, bytes, length);
+  Transmission wire = { copy, length, 0 };
+
+  // As large as the firmware's receive buffer, so ASan sees any overflow
+  uint8_t* received = (uint8_t*) malloc(uplink ? PROTOCOL_MAX_UPLINK_FRAME : PROTOCOL_MAX_DOWNLINK_FRAME);
+  uint8_t receivedLength = uplink ? protocolReceiveUplink(wire, received)
+                                  : protocolReceiveDownlink(wire, received);
+  free(copy);
+  // the module ignores a refused transmission, the master dispatches whatever it read
+  if (!uplink && receivedLength == 0) {
+    free(received);
+    return;
+  }
+
+  uint8_t* frame = (uint8_t*) malloc(receivedLength ? receivedLength : 1);
+  memcpy(frame, received, receivedLength);
+  free(received);
+  if (dispatch(uplink, frame, receivedLength)) {
+    uint8_t again[PROTOCOL_MAX_FRAME];
+    uint8_t againLength = encodedLength;
+    memcpy(again, encoded, againLength);
+    if (!dispatch(uplink, again, againLength) || memcmp(again, encoded, againLength) != 0) {
+      abort();
+    }
+  }
+  free(frame);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  size_t position = 0;
+  while (position < size) {
+    uint8_t header = data[position++];
+    bool uplink = header & 0x80;
+    size_t length = header & 0x7F;
+    if (length > size - position) {
+      length = size - position;
+    }
+    receive(uplink, data + position, length);
+    position += length;
+  }
+  return 0;
+}
+
+#if defined(STANDALONE) || defined(THROUGHPUT)
+/*
+ * A valid frame of a random message of one direction: random payload bytes
+ * decoded into the message and encoded back, so bool fields come out 0/1.
+ */
+#define FUZZ_ENCODER(name, fields) \
+  static uint8_t encodeRandom##name(const uint8_t* payload, uint8_t* frame) \
+  { \
+    name##Message message; \
+    protocolDecode(payload, message); \
+    return protocolEncode(message, frame); \
+  }
+
+PROTOCOL_DOWNLINK(FUZZ_ENCODER)
+PROTOCOL_UPLINK(FUZZ_ENCODER)
+
+typedef uint8_t (*FrameEncoder)(const uint8_t* payload, uint8_t* frame);
+#define FUZZ_ENCODER_ENTRY(name, fields) encodeRandom##name,
+static const FrameEncoder downlinkEncoders[] = { PROTOCOL_DOWNLINK(FUZZ_ENCODER_ENTRY) };
+static const FrameEncoder uplinkEncoders[] = { PROTOCOL_UPLINK(FUZZ_ENCODER_ENTRY) };
+
+static uint8_t randomFrame(bool uplink, uint8_t* frame)
+{
+  uint8_t payload[PROTOCOL_MAX_FRAME];
+  for (uint8_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = rand();
+  }
+  return uplink ? uplinkEncoders[rand() % PROTOCOL_UPLINK_COUNT](payload, frame)
+                : downlinkEncoders[rand() % PROTOCOL_DOWNLINK_COUNT](payload, frame);
+}
+#endif
+
+#if defined(STANDALONE)
+static void runFile(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    exit(1);
+  }
+  static uint8_t data[1 << 16];
+  size_t size = fread(data, 1, sizeof(data), file);
+  fclose(file);
+  LLVMFuzzerTestOneInput(data, size);
+}
+
+/*
+ * One transmission: a valid frame, cut short, padded or with a flipped
+ * byte, or plain random bytes of any length up to past the largest frame.
+ */
+static size_t randomTransmission(uint8_t* data)
+{
+  bool uplink = rand() % 2;
+  uint8_t* bytes = data + 1;
+  size_t length;
+  if (rand() % 2) {
+    length = randomFrame(uplink, bytes);
+    switch (rand() % 4) {
+      case 0: length = rand() % length; break;
+      case 1: while (length < PROTOCOL_MAX_FRAME + 8 && rand() % 2) bytes[length++] = rand(); break;
+      case 2: bytes[rand() % length] ^= 1 << (rand() % 8); break;
+    }
+  } else {
+    length = rand() % (PROTOCOL_MAX_FRAME + 8);
+    for (size_t i = 0; i < length; i++) {
+      bytes[i] = rand();
+    }
+  }
+  data[0] = length | (uplink ? 0x80 : 0);
+  return length + 1;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      runFile(argv[i]);
+    }
+    printf("%d inputs, %lu frames dispatched\n", argc - 1, dispatched);
+    return 0;
+  }
+
+  srand(1);
+  const long inputs = 200000;
+  uint8_t data[16 * (PROTOCOL_MAX_FRAME + 9)];
+  for (long n = 0; n < inputs; n++) {
+    size_t size = 0;
+    for (int count = 1 + rand() % 16; count > 0; count--) {
+      size += randomTransmission(data + size);
+    }
+    // the last length byte may promise more than is left
+    LLVMFuzzerTestOneInput(data, size - rand() % 2);
+  }
+  printf("%ld random inputs, %lu frames dispatched\n", inputs, dispatched);
+  return 0;
+}
+#elif defined(THROUGHPUT)
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static double nanosSince(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  srand(1);
+
+  // Messages per second over a pool of valid frames of both directions
+  const int POOL = 256;
+  static uint8_t pool[POOL][PROTOCOL_MAX_FRAME];
+  uint8_t poolLength[POOL];
+  for (int i = 0; i < POOL; i++) {
+    poolLength[i] = randomFrame(i % 2, pool[i]);
+  }
+  unsigned long messages = 0;
+  Clock::time_point start = Clock::now();
+  double budget = seconds * 1e9 / 2;
+  while (nanosSince(start) < budget) {
+    for (int i = 0; i < POOL; i++) {
+      messages += dispatch(i % 2, pool[i], poolLength[i]);
+    }
+  }
+  double elapsed = nanosSince(start) / 1e9;
+  printf("%lu messages in %.2f s, %.0f per second\n", messages, elapsed, messages / elapsed);
+
+  // Worst single dispatch per transmission length, valid prefixes and noise
+  const int LENGTHS = PROTOCOL_MAX_FRAME + 1;
+  double worst[2][LENGTHS] = {};
+  double total[2][LENGTHS] = {};
+  unsigned long rounds = 0;
+  start = Clock::now();
+  while (nanosSince(start) < budget) {
+    for (int length = 0; length < LENGTHS; length++) {
+      for (int random = 0; random < 2; random++) {
+        bool uplink = rand() % 2;
+        uint8_t frame[PROTOCOL_MAX_FRAME];
+        uint8_t valid = random ? 0 : randomFrame(uplink, frame);
+        for (int b = valid; b < PROTOCOL_MAX_FRAME; b++) {
+          frame[b] = rand();
+        }
+        Clock::time_point before = Clock::now();
+        dispatch(uplink, frame, length);
+        double nanos = nanosSince(before);
+        total[random][length] += nanos;
+        if (nanos > worst[random][length]) {
+          worst[random][length] = nanos;
+        }
+      }
+    }
+    rounds++;
+  }
+
+  // The worst case includes preemption on the host, the mean shows the parser
+  printf("dispatch time over %lu rounds, clock overhead included\n", rounds);
+  printf("length  valid mean ns  valid worst ns  random mean ns  random worst ns\n");
+  for (int length = 0; length < LENGTHS; length++) {
+    printf("%6d  %13.0f  %14.0f  %14.0f  %15.0f\n", length,
+           total[0][length] / rounds, worst[0][length], total[1][length] / rounds, worst[1][length]);
+  }
+  return 0;
+}
+#endif
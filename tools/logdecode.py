@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Decodes the binary TokenLog stream of the master or a module.
+
+Usage:
+  logdecode.py /dev/ttyACM0         read from a serial port (needs pyserial)
+  logdecode.py capture.bin          decode a raw capture
+  cat capture.bin | logdecode.py -  decode stdin
+"""
+
+import os
+import re
+import sys
+
+CATALOG = os.path.join(os.path.dirname(__file__), "..", "shared", "TokenLog", "LogMessages.h")
+BAUD = 250000
+SYNC = 0xA5
+LEVELS = {1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG"}
+
+
+def load_catalog(path):
+    with open(path) as header:
+        text = header.read()
+    return [(name, bytes(fmt, "utf-8").decode("unicode_escape"))
+            for name, fmt in re.findall(r'MSG\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', text)]
+
+
+def read_varint(data, position):
+    value = 0
+    shift = 0
+    while True:
+        if position >= len(data) or shift > 28:
+            raise IndexError
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, position
+
+
+def decode(data, catalog):
+    """Yields decoded lines and returns the number of unconsumed bytes."""
+    position = 0
+    while True:
+        start = data.find(bytes([SYNC]), position)
+        if start < 0:
+            return len(data)
+        try:
+            message = data[start + 1]
+            level = data[start + 2] >> 4
+            count = data[start + 2] & 0x0F
+            millis, cursor = read_varint(data, start + 3)
+            arguments = []
+            for _ in range(count):
+                zigzag, cursor = read_varint(data, cursor)
+                arguments.append((zigzag >> 1) ^ -(zigzag & 1))
+        except IndexError:
+            return len(data) - start
+
+        if message >= len(catalog) or level not in LEVELS or count > 3:
+            position = start + 1
+            continue
+
+        name, fmt = catalog[message]
+        try:
+            text = fmt % tuple(arguments)
+        except TypeError:
+            text = "%s %s" % (name, arguments)
+        yield "%10.3f %-5s %s" % (millis / 1000.0, LEVELS[level], text)
+        position = cursor
+
+
+def stream(source, catalog):
+    pending = b""
+    while True:
+        if hasattr(source, "in_waiting"):
+            chunk = source.read(max(1, source.in_waiting))
+        else:
+            chunk = source.read(64)
+        if not chunk:
+            break
+        pending += chunk
+        decoder = decode(pending, catalog)
+        try:
+            while True:
+                print(next(decoder), flush=True)
+        except StopIteration as done:
+            pending = pending[len(pending) - done.value:] if done.value else b""
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+    catalog = load_catalog(CATALOG)
+    target = sys.argv[1]
+    if target == "-":
+        stream(sys.stdin.buffer, catalog)
+    elif os.path.exists(target) and not target.startswith("/dev/"):
+        with open(target, "rb") as capture:
+            stream(capture, catalog)
+    else:
+        import serial
+        with serial.Serial(target, BAUD) as port:
+            stream(port, catalog)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
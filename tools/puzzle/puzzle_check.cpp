@@ -0,0 +1,221 @@
+/*
+ * Host check of the seed derived game state: runs edgeworkGenerate() and
+ * PuzzleEngine::begin() for many seeds and checks every result against the
+ * invariants the firmware relies on.
+ *
+ *   edgework  labels distinct and known, serial from the alphabet, battery
+ *             and port counts within the EDGEWORK_MAX_* limits
+ *   wires     PUZZLE_MIN_WIRES..PUZZLE_MAX_WIRES wires of known colours,
+ *             wireToCut() < wireCount(), and cutting each wire on a fresh
+ *             copy solves for exactly one wire, that one
+ *   button    a tap solves exactly when no hold is required, a hold released
+ *             at 0:00 strikes and one released on 0:01, 0:04 or 0:05 solves
+ *   seeds     the same seed gives the same edgework and puzzle again
+ *
+ * It also reports how long the precompute takes per seed on the host, the
+ * mean and the worst, which includes host preemption. Use it to compare
+ * rule changes against each other, not as AVR timing.
+ *
+ * From the repository root:
+ *   g++ -std=gnu++11 -O2 -Ishared/BombConstants -Ishared/Edgework -Imodule/lib/PuzzleEngine \
+ *     tools/puzzle/puzzle_check.cpp shared/BombConstants/BombConstants.cpp \
+ *     shared/Edgework/Edgework.cpp module/lib/PuzzleEngine/PuzzleEngine.cpp -o puzzle_check
+ *   ./puzzle_check [seeds] [first seed]
+ */
+
+#include <Edgework.h>
+#include <PuzzleEngine.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static unsigned long failures = 0;
+
+static void fail(uint32_t seed, const char* what)
+{
+  if (failures++ < 20) {
+    printf("seed %lu: %s\n", (unsigned long) seed, what);
+  }
+}
+
+static bool inAlphabet(char c)
+{
+  for (uint8_t i = 0; i < serialAlphabetLength(); i++) {
+    if (serialAlphabetCharacter(i) == c) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void checkEdgework(uint32_t seed, const Edgework& edgework)
+{
+  if (edgework.labelCount != EDGEWORK_LABELS) {
+    fail(seed, "label count");
+  }
+  for (uint8_t i = 0; i < edgework.labelCount; i++) {
+    if (edgework.labels[i].label >= LABEL_COUNT) {
+      fail(seed, "unknown label");
+    }
+    for (uint8_t j = 0; j < i; j++) {
+      if (edgework.labels[i].label == edgework.labels[j].label) {
+        fail(seed, "duplicate label");
+      }
+    }
+  }
+
+  if (strlen(edgework.serial) != SERIAL_NUMBER_LENGTH) {
+    fail(seed, "serial length");
+  }
+  for (uint8_t i = 0; i < SERIAL_NUMBER_LENGTH; i++) {
+    if (!inAlphabet(edgework.serial[i])) {
+      fail(seed, "serial character");
+    }
+  }
+
+  uint8_t aa = edgework.batteries[BATTERY_AA];
+  uint8_t d = edgework.batteries[BATTERY_D];
+  if (aa > EDGEWORK_MAX_BATTERIES_AA || d > EDGEWORK_MAX_BATTERIES_D || aa + d > EDGEWORK_MAX_BATTERIES_TOTAL) {
+    fail(seed, "battery limits");
+  }
+
+  uint8_t ports = 0;
+  for (uint8_t port = 0; port < PORT_COUNT; port++) {
+    if (edgework.ports[port] > EDGEWORK_MAX_PORTS_PER_TYPE) {
+      fail(seed, "ports per type");
+    }
+    ports += edgework.ports[port];
+  }
+  if (ports > EDGEWORK_MAX_PORTS_TOTAL) {
+    fail(seed, "ports total");
+  }
+}
+
+static void checkWires(uint32_t seed, const PuzzleEngine& puzzle)
+{
+  uint8_t wires = puzzle.wireCount();
+  if (wires < PUZZLE_MIN_WIRES || wires > PUZZLE_MAX_WIRES) {
+    fail(seed, "wire count");
+    return;
+  }
+  for (uint8_t i = 0; i < wires; i++) {
+    if (puzzle.wireColor(i) >= WIRE_COLOR_COUNT) {
+      fail(seed, "wire colour");
+    }
+  }
+  if (puzzle.wireToCut() >= wires) {
+    fail(seed, "wire to cut out of range");
+  }
+
+  uint8_t solving = 0;
+  for (uint8_t i = 0; i < wires; i++) {
+    PuzzleEngine copy = puzzle;
+    PuzzleOutcome outcome = copy.cut(i);
+    if (outcome == PUZZLE_SOLVED) {
+      solving++;
+      if (i != puzzle.wireToCut()) {
+        fail(seed, "a wire other than wireToCut() solves");
+      }
+      if (!copy.solved() || copy.cut(i) != PUZZLE_NOTHING) {
+        fail(seed, "solved module still takes cuts");
+      }
+    } else if (outcome != PUZZLE_STRIKE) {
+      fail(seed, "cut neither strikes nor solves");
+    }
+  }
+  if (solving != 1) {
+    fail(seed, "not exactly one solving wire");
+  }
+}
+
+static void checkButton(uint32_t seed, const PuzzleEngine& puzzle)
+{
+  PuzzleEngine tap = puzzle;
+  if ((tap.release(PUZZLE_TAP_MILLIS / 2, 0) == PUZZLE_SOLVED) == puzzle.holdRequired()) {
+    fail(seed, "tap outcome contradicts holdRequired()");
+  }
+  if (!puzzle.holdRequired()) {
+    return;
+  }
+
+  PuzzleEngine early = puzzle;
+  if (early.release(PUZZLE_TAP_MILLIS * 2, 0) != PUZZLE_STRIKE) {
+    fail(seed, "hold released at 0:00 solves");
+  }
+  static const uint16_t DIGIT_TIMES[] = { 1, 4, 5 };
+  uint8_t solving = 0;
+  for (uint8_t i = 0; i < 3; i++) {
+    PuzzleEngine copy = puzzle;
+    solving += copy.release(PUZZLE_TAP_MILLIS * 2, DIGIT_TIMES[i]) == PUZZLE_SOLVED;
+  }
+  if (solving != 1) {
+    fail(seed, "hold not solved by exactly one release digit");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned long seeds = argc > 1 ? strtoul(argv[1], 0, 0) : 5000000UL;
+  uint32_t first = argc > 2 ? strtoul(argv[2], 0, 0) : 0;
+
+  double edgeworkNanos = 0;
+  double puzzleNanos = 0;
+  double worstNanos = 0;
+  unsigned long holds = 0;
+  unsigned long wireCounts[PUZZLE_MAX_WIRES + 1] = {};
+
+  for (unsigned long n = 0; n < seeds; n++) {
+    uint32_t seed = first + n;
+    Edgework edgework;
+    PuzzleEngine puzzle;
+
+    Clock::time_point start = Clock::now();
+    edgeworkGenerate(seed, edgework);
+    Clock::time_point generated = Clock::now();
+    puzzle.begin(seed, edgework);
+    Clock::time_point solved = Clock::now();
+
+    double edgeworkTime = std::chrono::duration<double, std::nano>(generated - start).count();
+    double puzzleTime = std::chrono::duration<double, std::nano>(solved - generated).count();
+    edgeworkNanos += edgeworkTime;
+    puzzleNanos += puzzleTime;
+    if (edgeworkTime + puzzleTime > worstNanos) {
+      worstNanos = edgeworkTime + puzzleTime;
+    }
+
+    checkEdgework(seed, edgework);
+    checkWires(seed, puzzle);
+    checkButton(seed, puzzle);
+
+    Edgework again;
+    PuzzleEngine replay;
+    edgeworkGenerate(seed, again);
+    replay.begin(seed, again);
+    if (memcmp(&again, &edgework, sizeof(again)) != 0) {
+      fail(seed, "edgework differs for the same seed");
+    }
+    if (replay.wireCount() != puzzle.wireCount() || replay.wireToCut() != puzzle.wireToCut()
+        || replay.buttonColor() != puzzle.buttonColor() || replay.buttonLabel() != puzzle.buttonLabel()
+        || replay.stripColor() != puzzle.stripColor() || replay.holdRequired() != puzzle.holdRequired()) {
+      fail(seed, "puzzle differs for the same seed");
+    }
+
+    holds += puzzle.holdRequired();
+    if (puzzle.wireCount() <= PUZZLE_MAX_WIRES) {
+      wireCounts[puzzle.wireCount()]++;
+    }
+  }
+
+  printf("%lu seeds from %lu, %lu failures\n", seeds, (unsigned long) first, failures);
+  printf("precompute per seed: edgework %.0f ns, puzzle %.0f ns, worst total %.0f ns\n",
+         edgeworkNanos / seeds, puzzleNanos / seeds, worstNanos);
+  printf("wires:");
+  for (int wires = PUZZLE_MIN_WIRES; wires <= PUZZLE_MAX_WIRES; wires++) {
+    printf(" %d: %.1f%%", wires, 100.0 * wireCounts[wires] / seeds);
+  }
+  printf(", button held: %.1f%%\n", 100.0 * holds / seeds);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+"""PlatformIO post-build step that reports RAM and flash use against a budget.
+
+Enable it per environment in platformio.ini:
+
+  extra_scripts = post:../tools/size_budget.py
+  custom_ram_budget = 1536
+  custom_flash_budget = 28672
+
+The RAM figure is static RAM (.data + .bss + .noinit); whatever is left of
+the board's RAM is shared by heap and stack. The build fails when a budget
+is exceeded. The largest RAM symbols are listed to show where to cut.
+"""
+
+import os
+import subprocess
+
+Import("env")  # noqa: F821 - provided by SCons
+
+TOP_SYMBOLS = 8
+
+
+def section_sizes(size_tool, elf):
+    output = subprocess.check_output([size_tool, "-A", elf]).decode()
+    sections = {}
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            sections[parts[0]] = int(parts[1])
+    return sections
+
+
+def ram_symbols(nm_tool, elf):
+    output = subprocess.check_output([nm_tool, "--size-sort", "-S", "-C", elf]).decode()
+    symbols = []
+    for line in output.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) == 4 and parts[2] in "bBdD":
+            symbols.append((int(parts[1], 16), parts[3]))
+    return sorted(symbols, reverse=True)[:TOP_SYMBOLS]
+
+
+def report(source, target, env):
+    elf = str(target[0])
+    size_tool = env.subst("$SIZETOOL") or "avr-size"
+    nm_tool = os.path.join(os.path.dirname(size_tool), os.path.basename(size_tool).replace("size", "nm"))
+
+    sections = section_sizes(size_tool, elf)
+    flash = sections.get(".text", 0) + sections.get(".data", 0)
+    ram = sections.get(".data", 0) + sections.get(".bss", 0) + sections.get(".noinit", 0)
+
+    board = env.BoardConfig()
+    flash_total = int(board.get("upload.maximum_size"))
+    ram_total = int(board.get("upload.maximum_ram_size"))
+    flash_budget = int(env.GetProjectOption("custom_flash_budget", flash_total))
+    ram_budget = int(env.GetProjectOption("custom_ram_budget", ram_total))
+
+    print("")
+    print("Memory budget for %s" % env["PIOENV"])
+    print("  %-6s %6d / %6d budget / %6d total" % ("flash", flash, flash_budget, flash_total))
+    print("  %-6s %6d / %6d budget / %6d total, %d left for heap and stack"
+          % ("ram", ram, ram_budget, ram_total, ram_total - ram))
+    try:
+        print("  largest RAM symbols:")
+        for size, name in ram_symbols(nm_tool, elf):
+            print("    %6d  %s" % (size, name))
+    except (OSError, subprocess.CalledProcessError):
+        pass
+
+    failures = []
+    if flash > flash_budget:
+        failures.append("flash %d > %d" % (flash, flash_budget))
+    if ram > ram_budget:
+        failures.append("ram %d > %d" % (ram, ram_budget))
+    if failures:
+        print("Memory budget exceeded: " + ", ".join(failures))
+        env.Exit(1)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report)  # noqa: F821
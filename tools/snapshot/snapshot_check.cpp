@@ -0,0 +1,176 @@
+/*
+ * Host check of the game snapshot across resets of the master: plays games
+ * through the firmware's SnapshotRing on an in-memory EEPROM and resets at
+ * random points, part way through a write and with the byte being written
+ * torn. After each reset a fresh ring must load a snapshot resumeGame()
+ * accepts:
+ *
+ *   state     the last save that completed, or one queued after it, never a
+ *             mix of two saves
+ *   resume    running and the request line roster as saved, solved lines
+ *             and strikes as the game had them
+ *
+ * The game then carries on from what was loaded, as it does on the bomb, so
+ * the journal chains and ring wrap-arounds of many resets are covered. It
+ * also reports how many EEPROM bytes a save writes on average.
+ *
+ * From the repository root:
+ *   g++ -std=gnu++11 -O2 -Imaster/lib/GameSnapshot \
+ *     tools/snapshot/snapshot_check.cpp master/lib/GameSnapshot/GameSnapshot.cpp -o snapshot_check
+ *   ./snapshot_check [resets] [seed]
+ */
+
+#include <GameSnapshot.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+/* EEPROM */
+// ATmega2560
+static uint8_t eeprom[4096];
+static bool tearNextWrite = false;
+static unsigned long bytesWritten = 0;
+
+void eeprom_read_block(void* destination, const void* source, size_t length)
+{
+  memcpy(destination, eeprom + (size_t) source, length);
+}
+
+uint8_t eeprom_read_byte(const uint8_t* address)
+{
+  return eeprom[(size_t) address];
+}
+
+// A reset during the write leaves the cell with any value
+void eeprom_write_byte(uint8_t* address, uint8_t value)
+{
+  eeprom[(size_t) address] = tearNextWrite ? rand() : value;
+  bytesWritten++;
+}
+
+bool eeprom_is_ready()
+{
+  return true;
+}
+
+/* GAME */
+static const uint8_t ROSTER = 0x2D;
+static unsigned long failures = 0;
+
+static void fail(unsigned long reset, const char* what)
+{
+  if (failures++ < 20) {
+    printf("reset %lu: %s\n", reset, what);
+  }
+}
+
+static bool same(const GameSnapshot& a, const GameSnapshot& b)
+{
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static void newGame(GameSnapshot& game)
+{
+  memset(&game, 0, sizeof(game));
+  game.seed = ((uint32_t) rand() << 16) ^ rand();
+  game.baseTime = 300;
+  game.running = 1;
+  game.baseLives = 3;
+  game.currentLives = 3;
+  game.rosterMask = ROSTER;
+  memset(game.mistakeTrace, -1, sizeof(game.mistakeTrace));
+}
+
+// What the master saves between two resets: time passing, solves and strikes
+static void play(GameSnapshot& game)
+{
+  int event = rand() % 20;
+  if (event == 0) {
+    uint8_t line;
+    do {
+      line = rand() % 8;
+    } while (!(ROSTER & (1 << line)));
+    game.solvedMask |= 1 << line;
+  } else if (event == 1 && game.currentLives > 1) {
+    game.mistakeTrace[game.baseLives - game.currentLives] = rand() % 8;
+    game.currentLives--;
+  } else if (event == 2) {
+    newGame(game);
+  } else {
+    game.consumedQuarterMillis += 1000 + rand() % 4000;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned long resets = argc > 1 ? strtoul(argv[1], 0, 0) : 100000UL;
+  srand(argc > 2 ? strtoul(argv[2], 0, 0) : 1);
+  memset(eeprom, 0xFF, sizeof(eeprom));
+
+  GameSnapshot game;
+  newGame(game);
+  SnapshotRing first;
+  first.begin();
+  first.save(game);
+  while (first.writing()) {
+    first.service();
+  }
+  unsigned long saves = 1;
+
+  for (unsigned long reset = 0; reset < resets; reset++) {
+    SnapshotRing ring;
+    ring.begin();
+
+    // Saves since the last one that was written in full, any may be loaded
+    std::vector<GameSnapshot> candidates(1, game);
+    for (int pass = rand() % 200; pass > 0; pass--) {
+      if (rand() % 4 == 0) {
+        play(game);
+        ring.save(game);
+        candidates.push_back(game);
+        saves++;
+      }
+      ring.service();
+      if (!ring.writing()) {
+        candidates.assign(1, game);
+      }
+    }
+    if (ring.writing() && rand() % 2) {
+      tearNextWrite = true;
+      ring.service();
+      tearNextWrite = false;
+    }
+
+    SnapshotRing restarted;
+    restarted.begin();
+    GameSnapshot loaded;
+    if (!restarted.load(loaded)) {
+      fail(reset, "no snapshot after the reset");
+      continue;
+    }
+    bool known = false;
+    for (size_t i = 0; i < candidates.size() && !known; i++) {
+      known = same(loaded, candidates[i]);
+    }
+    if (!known) {
+      fail(reset, "loaded a snapshot that was never saved whole");
+    }
+    if (!loaded.running || loaded.rosterMask != ROSTER) {
+      fail(reset, "snapshot would not be resumed");
+    }
+    if (loaded.solvedMask & ~ROSTER) {
+      fail(reset, "solved line outside the roster");
+    }
+    for (uint8_t i = 0; i < SNAPSHOT_MAX_MISTAKES; i++) {
+      bool struck = i < loaded.baseLives - loaded.currentLives;
+      if (struck != (loaded.mistakeTrace[i] >= 0)) {
+        fail(reset, "strikes and mistake trace disagree");
+      }
+    }
+    game = loaded;
+  }
+
+  printf("%lu resets, %lu saves, %lu failures\n", resets, saves, failures);
+  printf("EEPROM bytes written per save: %.1f\n", (double) bytesWritten / saves);
+  return failures == 0 ? 0 : 1;
+}